@@ -6,10 +6,27 @@
 
 #define ROOTDEV 1        // 根磁盘设备号
 #define ROOT_INODE 1      // 根目录的 Inode 编号通常是 1
-#define BSIZE 1024  // 块大小
 #define FSMAGIC 0x88888888 // 文件系统魔数
 
-// [ boot | super | log | inode blocks | bitmap | data blocks ]
+// 块大小：编译时决定，Makefile 的 FSBSIZE 同时传给内核、用户程序和 mkfs，超级块里也记一份
+// 默认和页一样大，一页的文件读写只要一个 buffer、一次块映射、一个 virtio 请求
+#ifndef BSIZE
+#define BSIZE 4096
+#endif
+#if BSIZE < 1024 || (BSIZE & (BSIZE - 1)) != 0
+#error "BSIZE must be a power of two >= 1024"
+#endif
+
+// 按字节配置的缓存和日志大小换算成块数
+#define FSBUF_NUM (FSBUF_BYTES / BSIZE)
+#define LOGBLOCKS (LOG_BYTES / BSIZE)
+#define DATABLOCKS (LOG_DATA_BYTES / BSIZE)
+#if LOGBLOCKS < MAXOPBLOCKS
+#error "LOG_BYTES too small for MAXOPBLOCKS blocks of BSIZE"
+#endif
+
+// [ boot | super | log | inode blocks | inode bitmap | bitmap | data blocks ]
+// 各区的大小都由 mkfs 决定，记在超级块里
 
 // 磁盘上一块在内存中对应的缓存
 struct fsbuf {
@@ -20,7 +37,7 @@ struct fsbuf {
     uint refcnt;
     struct fsbuf *prev; // LRU cache list
     struct fsbuf *next;
-    uchar data[BSIZE];
+    uchar *data; // 块缓存里指向 fsbuf_cache 的存储，页缓存的请求头指向页里的一块
     struct sleeplock lock; // 保护这个 buffer 的内容
 };
 
@@ -34,20 +51,58 @@ struct superblock {
     uint logstart; // 日志区起始块号
     uint inodestart; // Inode 区起始块号
     uint bmapstart; // Bitmap 起始块号
+    uint flags; // 挂载选项，见下面的 FS_FLAG_*
+    uint nfree_blocks; // 空闲数据块数，随分配/释放一起进日志
+    uint nfree_inodes; // 空闲 inode 数
+    uint imapstart; // inode bitmap 起始块号
+    uint bsize; // 块大小，必须和内核编译时的 BSIZE 一样
 };
 
+// 有序日志模式：普通文件的数据块在事务提交前直接写回原位，
+// 日志里只记录 bitmap、inode、间接块和目录块这些元数据
+#define FS_FLAG_ORDERED 0x1
+// 超级块里的 nfree_blocks/nfree_inodes 有效；没有这个标记的旧镜像挂载时重新统计
+#define FS_FLAG_COUNTS 0x2
+// inode 用 10 直接 + 一级/二级/三级间接块；没有这个标记的是旧的 12 直接 + 1 间接布局，不能挂载
+#define FS_FLAG_TINDIRECT 0x4
+// dinode 带 flags 字段（major/minor 缩成一个字节），小文件的内容可以内联在 addrs 里
+#define FS_FLAG_INLINE 0x8
+// 目录项里的 inode 号是 32 位（名字缩到 12 字节，目录项还是 16 字节）
+#define FS_FLAG_WIDEDIR 0x10
+// 磁盘上有 inode bitmap（imapstart），挂载时不用扫 inode 表
+#define FS_FLAG_IMAP 0x20
+// 当前内核能挂载的镜像必须带的标记
+#define FS_FLAGS_REQUIRED (FS_FLAG_TINDIRECT | FS_FLAG_INLINE | FS_FLAG_WIDEDIR | FS_FLAG_IMAP)
+
+// 日志头占一块，最多记这么多个块号，超级块里的 nlog 再大也只用这么多
+#define FS_LOGMAX (LOGBLOCKS < BSIZE / sizeof(uint) - 1 ? LOGBLOCKS : BSIZE / sizeof(uint) - 1)
+
 // 磁盘上的日志头结构
 struct fslog_header {
     uint n; // 当前日志里有多少个有效块
-    uint block_nums[LOGBLOCKS]; // 记录每个日志块原本属于磁盘哪个位置
+    uint block_nums[FS_LOGMAX]; // 记录每个日志块原本属于磁盘哪个位置
 };
 
 // Inode 里的直接块数量
-#define NDIRECT 12
-// 一个间接块能存多少个指针？(1024 / 4 = 256)
+#define NDIRECT 10
+// 一个间接块能存多少个指针？(4096 / 4 = 1024)
 #define NINDIRECT (BSIZE / sizeof(uint))
-// 一个文件的最大块数
-#define MAXFILE (NDIRECT + NINDIRECT)
+// 二级、三级间接块能覆盖多少块
+#define NDINDIRECT (NINDIRECT * NINDIRECT)
+#define NTINDIRECT (NDINDIRECT * NINDIRECT)
+// addrs 的长度：直接块 + 一级、二级、三级间接块各一个
+// addrs[NDIRECT] 是一级，addrs[NDIRECT + 1] 是二级，addrs[NDIRECT + 2] 是三级
+#define NADDRS (NDIRECT + 3)
+// 一个文件的最大块数（1K 块约 16G，4K 块约 4T，实际都受 32 位的 size 限制在 4G 以内）
+#define MAXFILE (NDIRECT + NINDIRECT + NDINDIRECT + NTINDIRECT)
+// 一个文件的最大字节数
+#define MAXFILE_BYTES ((uint64) MAXFILE * BSIZE)
+
+// inode 标志 (dinode.flags)
+// 内容直接存在 addrs 里（最多 FS_INLINE_MAX 字节），不占数据块；
+// 新建的普通文件和目录都从内联开始，写超了自动转成块映射，截断到 0 又变回内联
+#define I_INLINE 0x1
+#define FS_INLINE_MAX (NADDRS * sizeof(uint))
 
 // 文件类型
 #define T_DIR     1   // 目录
@@ -57,11 +112,12 @@ struct fslog_header {
 // 磁盘上的inode结构
 struct dinode {
     short type; // 文件类型 (0代表空闲)
-    short major; // 主设备号 (T_DEVICE only)
-    short minor; // 次设备号 (T_DEVICE only)
+    uchar major; // 主设备号 (T_DEVICE only)
+    uchar minor; // 次设备号 (T_DEVICE only)
     short nlink; // 硬链接计数
+    ushort flags; // I_INLINE 等
     uint size; // 文件大小(字节)
-    uint addrs[NDIRECT + 1]; // 数据块地址 (12个直接 + 1个间接)
+    uint addrs[NADDRS]; // 数据块地址 (10个直接 + 一级/二级/三级间接各 1 个)
 };
 
 // 内存中的 Inode (In-memory copy of an inode)
@@ -75,21 +131,83 @@ struct inode {
     short major;
     short minor;
     short nlink;
+    ushort flags;
     uint size;
-    uint addrs[NDIRECT + 1];
+    uint addrs[NADDRS]; // I_INLINE 时存的是文件内容
+    uint ra_end; // 普通文件已经预读到的页号（不含），顺序读到这里才触发下一次预读
     struct sleeplock lock;
+    uint dir_free; // 目录：这个偏移之前没有空槽位，fs_dir_link 从这里开始找
+    // 块映射缓存，只管间接块覆盖的部分，截断时清空
+    uint map_lbn, map_pbn, map_len; // 最近一段物理连续的映射：逻辑块 [map_lbn, map_lbn + map_len) -> map_pbn 起
+    uint ind_lbn, ind_addr; // 最近用过的最底层间接块（0 表示没有），它管逻辑块 [ind_lbn, ind_lbn + NINDIRECT)
+    struct inode *hnext; // 哈希桶链表 / 空闲槽位链表
+    struct inode *lru_prev; // ref == 0 且有效的 inode 挂在 LRU 上，随时可被复用
+    struct inode *lru_next;
+    // 页缓存（只有普通文件用）：按文件内页号索引的基数树
+    void *pc_root;
+    int pc_height; // 树高，0 表示空树
+    uint pc_npages; // 缓存了几页
+    uint pc_nbusy; // 其中脏的、在做 I/O 的、等提交的页数，不为 0 时 inode 槽位不能回收
 };
 
 
 // 文件名大小
-#define DIRSIZ 14
+#define DIRSIZ 12
 
 // 目录项每一项结构
 struct dirent {
-    ushort inum; // Inode 编号
+    uint inum; // Inode 编号
     char name[DIRSIZ]; // 文件名
 };
 
+// ================= 哈希索引目录 =================
+// 目录第一块放满之后转成索引格式（类似 ext3 的 htree）：
+//   第 0 块：槽位 0/1 还是 "." 和 ".."，槽位 2 是 dx_root，槽位 3 起是索引项
+//   叶子块：普通的目录项块，同一块里的名字哈希落在同一个区间
+//   中间节点块（两层时）：槽位 0 是 dx_node，槽位 1 起是索引项
+// 索引结构都是 16 字节、开头四个字节为 0，按目录项线性读的代码（ls 等）会当成空槽跳过
+// 索引项按哈希升序排列，第 i 项指向哈希 >= hash 且 < 下一项 hash 的叶子（第 0 项 hash 视为 0）
+#define DX_ROOT_MAGIC 0xd1d1
+#define DX_NODE_MAGIC 0xd1d2
+#define DX_ROOT_SLOT 2 // dx_root 在第 0 块的槽位
+#define DX_ROOT_LIMIT (BSIZE / sizeof(struct dirent) - DX_ROOT_SLOT - 1) // 根里能放几个索引项
+#define DX_NODE_LIMIT (BSIZE / sizeof(struct dirent) - 1) // 中间节点能放几个索引项
+#define DX_MAXLEVELS 2
+
+struct dx_root {
+    uint zero; // 占着 dirent.inum 的位置，恒为 0
+    ushort magic; // DX_ROOT_MAGIC
+    uchar levels; // 1：根直接指向叶子；2：根 -> 中间节点 -> 叶子
+    uchar pad;
+    ushort count; // 索引项个数
+    ushort pad2;
+    uint pad3;
+};
+
+struct dx_node {
+    uint zero;
+    ushort magic; // DX_NODE_MAGIC
+    ushort count;
+    uint pad[2];
+};
+
+struct dx_entry {
+    uint zero;
+    uint hash; // 这个子树里最小的哈希
+    uint block; // 目录文件内的逻辑块号
+    uint pad;
+};
+
+// 目录项名字的哈希（FNV-1a），内核和 mkfs 共用
+static inline uint dx_hash(const char *name) {
+    uint h = 2166136261u;
+    for (int i = 0; i < DIRSIZ && name[i]; i++) {
+        h ^= (uchar) name[i];
+        h *= 16777619u;
+    }
+    return h;
+}
+
 // ================= 核心定位宏定义 =================
 
 // 计算一个块能存多少个 dinode
@@ -99,7 +217,7 @@ struct dirent {
 // 公式：inode区起始块 + (i / 每块数量)
 #define IBLOCK(i, sb) ((i) / IPB + sb.inodestart)
 
-// 计算一个块能存多少个 bitmap 位 (1024 * 8 = 8192)
+// 计算一个块能存多少个 bitmap 位 (4096 * 8 = 32768)
 #define BPB (BSIZE*8)
 
 // 计算第 b 个数据块对应的 bitmap 位于磁盘的第几块
@@ -110,8 +228,36 @@ void virtio_disk_init(void);
 
 void virtio_disk_rw(struct fsbuf *b, int write);
 
+void virtio_disk_submit(struct fsbuf *b, int write);
+
+void virtio_disk_submit_vec(uint blockno, struct fsbuf **bufs, int n, int write);
+
+void virtio_disk_wait(struct fsbuf *b);
+
+void virtio_disk_wait_mode(struct fsbuf *b, int mode);
+
+int virtio_disk_set_poll(int mode);
+
+int virtio_disk_maxseg();
+
+int virtio_disk_can_submit(int n);
+
+int virtio_disk_inflight();
+
 void virtio_disk_intr();
 
+struct diskstat;
+void virtio_disk_stat(struct diskstat *st);
+
+// iosched.c
+void iosched_submit(struct fsbuf *b, int write);
+
+void iosched_rw(struct fsbuf *b, int write);
+
+void iosched_dispatch();
+
+void iosched_stat(struct diskstat *st);
+
 void virtio_disk_test(void);
 
 // fsbuf.c
@@ -119,19 +265,42 @@ void fsbuf_init(void);
 
 struct fsbuf *fsbuf_read(uint dev, uint blockno);
 
+struct fsbuf *fsbuf_overwrite(uint dev, uint blockno);
+
 void fsbuf_write(struct fsbuf *b);
 
 void fsbuf_release(struct fsbuf *b);
 
+void fsbuf_pin(struct fsbuf *b);
+
+void fsbuf_unpin(struct fsbuf *b);
+
+void fsbuf_write_vec(uint blockno, struct fsbuf **bufs, int n);
+
+void fsbuf_write_sorted(struct fsbuf **bufs, int n);
+
+void fsbuf_readahead(uint dev, uint blockno, int n);
+
 void fsbuf_dump_list(void);
 
 void fsbuf_test(void);
 
 void fsbuf_test_lru(void);
 
+// dcache.c
+int dcache_lookup(uint dev, uint parent, char *name, uint *inum, uint *off);
+
+void dcache_enter(uint dev, uint parent, char *name, uint inum, uint off);
+
+void dcache_purge_dir(uint dev, uint parent);
+
 // fs.c
 void fs_init(int dev, int debug);
 
+void fs_inode_init();
+
+void fs_sb_flush(void);
+
 void fs_inode_lock(struct inode *ip);
 
 void fs_inode_unlock(struct inode *ip);
@@ -144,8 +313,16 @@ void fs_inode_write(struct inode *ip);
 
 uint fs_inode_map(struct inode *ip, uint bn);
 
+uint fs_inode_bmap(struct inode *ip, uint bn);
+
+uint fs_inode_alloc_run(struct inode *ip, uint bn, uint want, uint *got);
+
+void fs_inline_to_blocks(struct inode *ip);
+
 struct inode *fs_inode_alloc(uint dev, short type);
 
+struct inode *fs_inode_alloc_near(uint dev, short type, uint near);
+
 void fs_inode_trunc(struct inode *ip);
 
 void fs_inode_release(struct inode *ip);
@@ -158,6 +335,12 @@ struct inode *fs_dir_lookup(struct inode *dp, char *name, uint *poff);
 
 int fs_dir_link(struct inode *dp, char *name, uint inum);
 
+void fs_dir_unlink(struct inode *dp, char *name, uint off);
+
+int fs_dir_is_empty(struct inode *dp);
+
+int fs_namecmp(const char *a, const char *b);
+
 struct inode *fs_namei(char *path);
 
 struct inode *fs_nameiparent(char *path, char *name);
@@ -178,13 +361,48 @@ void fs_test_recursive(int dev);
 
 void fs_test_stress(int dev);
 
+// pcache.c
+void pcache_init(void);
+
+int pcache_read(struct inode *ip, int is_user_addr, char *dst, uint off, uint n);
+
+int pcache_write(struct inode *ip, int is_user_addr, char *src, uint off, uint n);
+
+char *pcache_map(struct inode *ip, uint index);
+
+void pcache_dup(struct inode *ip, uint index);
+
+void pcache_unmap(struct inode *ip, uint index, int dirty);
+
+void pcache_truncate(struct inode *ip);
+
+int pcache_evict(struct inode *ip);
+
+void pcache_commit(void);
+
+int pcache_txn_full(void);
+
+int pcache_shrink(void);
+
+void pcache_flusher(void);
+
+void pcache_stat(uint64 *cached, uint64 *dirty);
+
 // fslog.c
-void fslog_init(int dev, struct superblock *sb, int debug);
+int fslog_init(int dev, struct superblock *sb, int debug);
 
 void fslog_write(struct fsbuf *b);
 
+void fslog_write_data(struct fsbuf *b);
+
+void fslog_forget(uint blockno);
+
 void fslog_op_begin();
 
 void fslog_op_end();
 
+void fslog_commit();
+
+int fslog_room();
+
 #endif //RISCV_OS_FS_H
@@ -5,5 +5,7 @@ void kmem_init(void);
 void kmem_free(void *phys_addr);
 void kmem_dump(void);
 void *kmem_alloc(void);
+void *kmem_try_alloc(void);
+uint64 kmem_free_pages(void);
 
 #endif //KALLOC_H
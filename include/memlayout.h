@@ -24,7 +24,10 @@
 
 // 用户能访问到的最高虚拟内存地址
 #define MAX_USER_VA (MAX_VIRTUAL_ADDR>>1)
-#define USER_STACK_VA (MAX_USER_VA-PAGE_SIZE) //用户栈的虚拟地址
+#define USER_STACK_VA (MAX_USER_VA-PAGE_SIZE) //用户栈最高一页的虚拟地址，exec 时映射
+#define USER_STACK_MAX (256*PAGE_SIZE) // 用户栈最多长到 1MB
+#define USER_STACK_LIMIT (MAX_USER_VA-USER_STACK_MAX) // 栈区的最低地址，栈往下缺页时按需长，不会低于这里
+#define USER_MMAP_TOP (USER_STACK_LIMIT-PAGE_SIZE) // mmap 从这里往下分配地址，和栈区之间空一页作为保护页
 
 // 内核的虚拟地址空间
 #define TRAMPOLINE (MAX_VIRTUAL_ADDR - PAGE_SIZE) // <-- 跳板代码页 (S/U 模式均可访问, 可执行)
@@ -5,10 +5,26 @@
 
 // 文件系统块缓冲区大小
 #define MAXOPBLOCKS  100  // max # of blocks any FS op writes
-#define LOGBLOCKS (MAXOPBLOCKS*3)  // max data blocks in on-disk log
-#define FSBUF_NUM (MAXOPBLOCKS*3) // 为什么是30？先不管
-#define NINODE       50  // 缓存的活跃inodes数量
-// 文件系统块数
+// 块缓存和日志按字节配置，块数在 fs.h 里按 BSIZE 换算（FSBUF_NUM、LOGBLOCKS、DATABLOCKS）
+#define LOG_BYTES (512 * 1024) // 日志区最多记多少字节（还受日志头一块能记多少块号限制）
+#define LOG_DATA_BYTES (128 * 1024) // 有序日志模式下一个事务暂存的数据块最多多少字节，满了提前写回
+#define FSBUF_BYTES (1024 * 1024) // 块缓存一共多大
+#define FSBUF_READAHEAD 16 // 一次预读最多多少块
+#define FS_MAXBMAP 1024 // 块 bitmap、inode bitmap 各自最多多少块（分配器的内存统计用），1K 块时约 8G、八百万个 inode
+#define FS_READAHEAD 8 // 顺序读文件时额外往后预读多少页
+#define FS_ALLOC_RUN 32 // 写目录时一次最多连续分配多少块
+#define FS_FREE_BATCH 128 // 截断时攒多少个块号排序后一起释放
+#define IOSCHED_QUEUE 64 // I/O 调度队列长度
+#define IOSCHED_DEPTH 4 // 设备上同时在飞的请求达到这么多就先排队
+#define IOSCHED_DEADLINE 500000 // 排队超过这么久（time CSR 计数，约 50ms）优先下发
+#define DCACHE_NUM   256 // 目录项缓存条数
+#define DCACHE_HASH  64  // 目录项缓存哈希桶数
+#define ITABLE_HASH  128 // inode 缓存的哈希桶数
+#define ITABLE_MEM_FRACTION 64 // inode 缓存最多占挂载时空闲内存的几分之一
+#define PCACHE_MEM_FRACTION 4 // 页缓存最多占挂载时空闲内存的几分之一
+#define PCACHE_SCAN 64 // 回收页时从 LRU 尾部最多看多少页
+#define PCACHE_FLUSH_TICKS 100 // 脏页多久写回一次（时钟中断数，约 1 秒）
+// mkfs 默认的文件系统块数，可以用 -s 指定
 #define FSSIZE 2000
 
 #define MAXPATH      128
@@ -3,6 +3,7 @@
 #include "file.h"
 #include "riscv.h"
 #include "types.h"
+#include "vma.h"
 
 // 进程陷入内核态进行调度切换时保存上下文
 struct context {
@@ -117,6 +118,8 @@ struct proc {
 
     struct file *open_file[NOFILE];  // NOFILE 通常定义为 16
     struct inode *cwd; // 当前工作目录
+    struct vma vmas[NVMA]; // mmap 出来的映射
+    int ilocks; // 拿着几个 inode 锁，缺页处理据此判断能不能等映射的文件的锁
 };
 
 struct cpu {
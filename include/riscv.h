@@ -184,6 +184,14 @@ w_sepc(uint64 x) {
     asm volatile("csrw sepc, %0" : : "r" (x));
 }
 
+// Supervisor Trap Value，缺页时是出错的虚拟地址
+static __attribute__((unused)) uint64
+r_stval() {
+    uint64 x;
+    asm volatile("csrr %0, stval" : "=r" (x) );
+    return x;
+}
+
 // Supervisor Trap-Vector Base Address
 // low two bits are mode.
 static __attribute__((unused)) void
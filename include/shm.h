@@ -0,0 +1,27 @@
+#ifndef RISCV_OS_SHM_H
+#define RISCV_OS_SHM_H
+
+#include "types.h"
+#include "riscv.h"
+
+#define MAX_SHMS 16
+#define SHM_MAXPAGES (PAGE_SIZE / sizeof(char *)) // 一段最多几页：页指针表就占一页
+
+// 共享内存段：按 key 找到同一段的进程映射的是同一批物理页
+// 映射着它的 vma 各占一个引用，最后一个解除映射时连物理页一起释放
+struct shmseg {
+    int key; // 0 是匿名段（MAP_SHARED | MAP_ANONYMOUS），不能按 key 找到
+    int ref; // 引用数，0 表示槽位空闲
+    uint npages;
+    char **pages; // 页指针表，还没访问过的页为 0
+};
+
+struct shmseg *shm_get(int key, uint64 size);
+
+void shm_dup(struct shmseg *s);
+
+void shm_put(struct shmseg *s);
+
+char *shm_page(struct shmseg *s, uint index);
+
+#endif //RISCV_OS_SHM_H
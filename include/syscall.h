@@ -24,6 +24,11 @@
 #define SYSCALL_unlink 19
 #define SYSCALL_sleep 20
 #define SYSCALL_uptime 21
+#define SYSCALL_diskstat 22
+#define SYSCALL_diskpoll 23
+#define SYSCALL_mmap 24
+#define SYSCALL_munmap 25
+#define SYSCALL_shm_open 26
 #define SYSCALL_fslog_crash 100
 
 #ifndef __ASSEMBLER__
@@ -71,12 +76,22 @@ uint64 syscall_sleep(void);
 
 uint64 syscall_uptime(void);
 
+uint64 syscall_diskstat(void);
+
+uint64 syscall_diskpoll(void);
+
+uint64 syscall_mmap(void);
+
+uint64 syscall_munmap(void);
+
 uint64 syscall_sem_open(void);
 
 uint64 syscall_sem_wait(void);
 
 uint64 syscall_sem_signal(void);
 
+uint64 syscall_shm_open(void);
+
 uint64 syscall_sbrk(void);
 
 uint64 syscall_chdir(void);
@@ -12,13 +12,44 @@ struct sysinfo {
     uint64 free_blocks;
     uint64 total_inodes;
     uint64 free_inodes;
+    uint64 block_size;
+    uint64 cached_pages; // 页缓存里的文件页数
+    uint64 dirty_pages; // 其中还没写回的
+    uint64 free_pages; // 空闲的物理页数
 };
 
+// 磁盘驱动统计
+struct diskstat {
+    uint64 requests; // 提交给设备的请求数
+    uint64 blocks; // 请求里一共带了多少块
+    uint64 notifies; // 真正写 QUEUE_NOTIFY 的次数
+    uint64 notify_skips; // 因为 EVENT_IDX 省掉的通知
+    uint64 interrupts; // 收到的磁盘中断次数
+    uint64 indirect; // 是否协商到了 INDIRECT_DESC
+    uint64 event_idx; // 是否协商到了 EVENT_IDX
+    uint64 poll_mode; // 当前全局等待方式 DISK_WAIT_*
+    uint64 poll_hits; // 轮询期间就完成了，没有睡眠
+    uint64 poll_misses; // 轮询超时，退回睡眠等中断
+    uint64 poll_budget; // 当前轮询时长上限（time CSR 计数）
+    uint64 sched_queued; // 进过调度队列的请求数
+    uint64 sched_dispatched; // 调度器下发的请求数（合并后）
+    uint64 sched_merged; // 被合并进相邻请求的块数
+    uint64 sched_expired; // 排队超时被优先下发的次数
+    uint64 sched_depth; // 当前队列深度
+    uint64 sched_max_depth; // 队列最大深度
+};
+
+// 等待磁盘请求完成的方式
+#define DISK_WAIT_DEFAULT (-1) // 跟随全局设置
+#define DISK_WAIT_INTR 0 // 直接睡眠等中断
+#define DISK_WAIT_POLL 1 // 先在 used ring 上轮询一小段时间，超时再睡
+
 struct stat {
     int dev; // File system's disk device
     unsigned int ino; // Inode number
     short type; // Type of file
     short nlink; // Number of links to file
+    unsigned short flags; // inode 标志，I_INLINE 表示内容内联在 inode 里
     unsigned long long size; // Size of file in bytes
 };
 
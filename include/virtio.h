@@ -52,7 +52,15 @@
 
 // this many virtio descriptors.
 // must be a power of two.
-#define NUM 8
+// a single-block request takes 3 of them (header, data, status).
+#define NUM 32
+
+// one request carries at most this many data blocks (plus header and status).
+// with VIRTIO_RING_F_INDIRECT_DESC the whole chain lives in a per-request
+// table and takes a single ring descriptor; without it a request is split
+// into chunks of VIRTIO_DIRECT_MAXSEG so several can share the ring.
+#define VIRTIO_MAXSEG 64
+#define VIRTIO_DIRECT_MAXSEG 8
 #include "types.h"
 
 // a single descriptor, from the spec.
@@ -64,13 +72,14 @@ struct virtq_desc {
 };
 #define VRING_DESC_F_NEXT  1 // chained with another descriptor
 #define VRING_DESC_F_WRITE 2 // device writes (vs read)
+#define VRING_DESC_F_INDIRECT 4 // addr points to a table of descriptors
 
 // the (entire) avail ring, from the spec.
 struct virtq_avail {
   uint16 flags; // always zero
   uint16 idx;   // driver will write ring[idx] next
   uint16 ring[NUM]; // descriptor numbers of chain heads
-  uint16 unused;
+  uint16 used_event; // with EVENT_IDX: interrupt me once used->idx passes this
 };
 
 // one entry in the "used" ring, with which the
@@ -84,8 +93,15 @@ struct virtq_used {
   uint16 flags; // always zero
   uint16 idx;   // device increments when it adds a ring[] entry
   struct virtq_used_elem ring[NUM];
+  uint16 avail_event; // with EVENT_IDX: notify me once avail->idx passes this
 };
 
+// EVENT_IDX rule from the spec: should the other side be told, given that
+// its index moved from old_idx to new_idx and the peer asked for event_idx?
+static inline int vring_need_event(uint16 event_idx, uint16 new_idx, uint16 old_idx) {
+  return (uint16) (new_idx - event_idx - 1) < (uint16) (new_idx - old_idx);
+}
+
 // these are specific to virtio block devices, e.g. disks,
 // described in Section 5.2 of the spec.
 
@@ -5,12 +5,16 @@
 #include "riscv.h"
 
 // vm.c
+#define VMEM_ALLOC_TRY 2 // vmem_walk_pte 的 alloc：缺的页表页分配不到时返回 0，不 panic
+
 pagetable_t vmem_create_pagetable(void);
 
 pte_t *vmem_walk_pte(pagetable_t pagetable, uint64 virtual_addr, int alloc);
 
 int vmem_map_pagetable(pagetable_t pagetable, uint64 virtual_addr, uint64 physical_addr, int permission);
 
+int vmem_map_try(pagetable_t pagetable, uint64 virtual_addr, uint64 physical_addr, int permission);
+
 int vmem_unmap_pagetable(pagetable_t pagetable, uint64 virtual_addr, int do_free);
 
 void vmem_free_pagetable(pagetable_t pagetable);
@@ -23,10 +27,18 @@ int vmem_user_copy(pagetable_t src_pt, pagetable_t dst_pt, uint64 size);
 
 int vmem_stack_copy(pagetable_t src_pt, pagetable_t dst_pt);
 
+uint64 vmem_stack_base(pagetable_t pagetable);
+
+int vmem_stack_grow(pagetable_t pagetable, uint64 va);
+
+void vmem_user_prefault(pagetable_t pagetable, uint64 va, uint64 len, int write);
+
 int vmem_copyin(pagetable_t pagetable, char *dst_kernel, uint64 src_user, uint64 len);
 
 int vmem_copyout(pagetable_t pagetable, uint64 dst_user, char *src_kernel, uint64 len);
 
+int vmem_zeroout(pagetable_t pagetable, uint64 dst_user, uint64 len);
+
 int vmem_user_alloc(pagetable_t pagetable, uint64 old_size, uint64 new_size);
 
 uint64 vmem_user_dealloc(pagetable_t pagetable, uint64 old_size, uint64 new_size);
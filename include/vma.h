@@ -0,0 +1,46 @@
+#ifndef RISCV_OS_VMA_H
+#define RISCV_OS_VMA_H
+
+#include "types.h"
+
+// mmap 的权限和标志，和 user.h 里的一致
+#define PROT_READ  0x1
+#define PROT_WRITE 0x2
+#define PROT_EXEC  0x4
+
+#define MAP_SHARED    0x1 // 写进文件，其他映射同一文件的进程看得到
+#define MAP_PRIVATE   0x2 // 写只改自己的副本
+#define MAP_ANONYMOUS 0x4 // 不对应文件，初始全 0
+
+// 每个进程最多几段映射
+#define NVMA 16
+
+struct inode;
+struct proc;
+struct shmseg;
+
+// 进程地址空间里 mmap 出来的一段 [start, end)，页对齐
+// mmap 只占地址范围，页在第一次访问时由缺页处理映射
+struct vma {
+    uint64 start; // 0 表示槽位空闲
+    uint64 end;
+    int prot; // PROT_*
+    int flags; // MAP_*
+    struct inode *ip; // 文件映射占着 inode 的一个引用，匿名映射为 0
+    struct shmseg *shm; // 共享内存段（包括共享的匿名映射），占着段的一个引用
+    uint64 off; // start 对应的文件偏移（共享内存段里的偏移），页对齐
+};
+
+uint64 vma_mmap(struct proc *p, uint64 len, int prot, int flags, struct inode *ip, struct shmseg *shm, uint64 off);
+
+int vma_munmap(struct proc *p, uint64 addr, uint64 len);
+
+int vma_fault(struct proc *p, uint64 va, int access);
+
+int vma_fork(struct proc *p, struct proc *np);
+
+void vma_unmap_all(struct proc *p);
+
+uint64 vma_lowest(struct proc *p);
+
+#endif //RISCV_OS_VMA_H
@@ -0,0 +1,125 @@
+#include "../include/fs.h"
+#include "../include/param.h"
+#include "../include/string.h"
+
+// 目录项缓存：(父目录 inum, 名字) -> inum
+// inum 为 0 的是负缓存，表示"这个目录里没有这个名字"，open 不存在的文件也不用再扫目录
+// 目录内容变化时由 fs_dir_link / unlink / 删除目录的地方同步更新，索引目录拆分叶子挪了目录项也会更新偏移
+// 固定大小，按 LRU 淘汰
+
+struct dentry {
+    uint dev;
+    uint parent; // 父目录 inum，0 表示这一项没在用
+    char name[DIRSIZ];
+    uint inum; // 0 表示负缓存
+    uint off; // 目录项在父目录文件里的偏移，unlink 要用
+    struct dentry *hnext; // 哈希桶链表
+    struct dentry *prev; // LRU 链表
+    struct dentry *next;
+};
+
+static struct {
+    struct dentry entries[DCACHE_NUM];
+    struct dentry *hash[DCACHE_HASH];
+    struct dentry head; // LRU 哨兵，head.next 是最近用过的
+    int inited;
+} dcache;
+
+static struct dentry **dcache_bucket(uint dev, uint parent, const char *name) {
+    uint h = dev * 31 + parent;
+    for (int i = 0; i < DIRSIZ && name[i]; i++)
+        h = h * 31 + (uchar) name[i];
+    return &dcache.hash[h % DCACHE_HASH];
+}
+
+static void dcache_init() {
+    dcache.head.next = dcache.head.prev = &dcache.head;
+    for (int i = 0; i < DCACHE_NUM; i++) {
+        struct dentry *d = &dcache.entries[i];
+        d->parent = 0;
+        d->next = dcache.head.next;
+        d->prev = &dcache.head;
+        dcache.head.next->prev = d;
+        dcache.head.next = d;
+    }
+    dcache.inited = 1;
+}
+
+// 挪到 LRU 头部
+static void dcache_touch(struct dentry *d) {
+    d->prev->next = d->next;
+    d->next->prev = d->prev;
+    d->next = dcache.head.next;
+    d->prev = &dcache.head;
+    dcache.head.next->prev = d;
+    dcache.head.next = d;
+}
+
+static struct dentry *dcache_find(uint dev, uint parent, const char *name) {
+    if (!dcache.inited)
+        dcache_init();
+    for (struct dentry *d = *dcache_bucket(dev, parent, name); d; d = d->hnext) {
+        if (d->dev == dev && d->parent == parent && fs_namecmp(d->name, name) == 0)
+            return d;
+    }
+    return 0;
+}
+
+// 从哈希桶里摘掉，槽位留在 LRU 尾部等复用
+static void dcache_drop(struct dentry *d) {
+    struct dentry **pp = dcache_bucket(d->dev, d->parent, d->name);
+    while (*pp != d)
+        pp = &(*pp)->hnext;
+    *pp = d->hnext;
+    d->hnext = 0;
+    d->parent = 0;
+    d->prev->next = d->next;
+    d->next->prev = d->prev;
+    d->prev = dcache.head.prev;
+    d->next = &dcache.head;
+    dcache.head.prev->next = d;
+    dcache.head.prev = d;
+}
+
+// 查缓存：命中返回 1，*inum 为 0 表示确定不存在；没命中返回 0
+int dcache_lookup(uint dev, uint parent, char *name, uint *inum, uint *off) {
+    struct dentry *d = dcache_find(dev, parent, name);
+    if (d == 0)
+        return 0;
+    dcache_touch(d);
+    *inum = d->inum;
+    if (off)
+        *off = d->off;
+    return 1;
+}
+
+// 记下一条查找结果，inum 为 0 记负缓存
+void dcache_enter(uint dev, uint parent, char *name, uint inum, uint off) {
+    struct dentry *d = dcache_find(dev, parent, name);
+    if (d == 0) {
+        // 用 LRU 尾部最久没用的槽位
+        d = dcache.head.prev;
+        if (d->parent != 0)
+            dcache_drop(d);
+        d->dev = dev;
+        d->parent = parent;
+        strncpy(d->name, name, DIRSIZ);
+        struct dentry **bucket = dcache_bucket(dev, parent, name);
+        d->hnext = *bucket;
+        *bucket = d;
+    }
+    d->inum = inum;
+    d->off = off;
+    dcache_touch(d);
+}
+
+// 目录本身被删掉了，inum 会被复用，它下面的所有项都作废
+void dcache_purge_dir(uint dev, uint parent) {
+    if (!dcache.inited)
+        return;
+    for (int i = 0; i < DCACHE_NUM; i++) {
+        struct dentry *d = &dcache.entries[i];
+        if (d->parent == parent && d->dev == dev)
+            dcache_drop(d);
+    }
+}
@@ -67,7 +67,8 @@ static int load_elf_from_inode(struct inode *ip, pagetable_t *out_pagetable, uin
 
         // 为该段分配内存并加载数据
         for (uint64 va = ph.vaddr; va < ph.vaddr + ph.memsz; va += PAGE_SIZE) {
-            char *pa = kmem_alloc();
+            // 内存不够就让 exec 失败，不要 panic
+            char *pa = kmem_try_alloc();
             if (pa == 0) goto bad;
 
             memset(pa, 0, PAGE_SIZE); // 清零 (处理 .bss)
@@ -87,14 +88,13 @@ static int load_elf_from_inode(struct inode *ip, pagetable_t *out_pagetable, uin
             }
 
             // 映射
-            if (vmem_map_pagetable(pagetable, va, (uint64)pa, pte_flags) != 0) {
+            if (vmem_map_try(pagetable, va, (uint64)pa, pte_flags) != 0) {
                 kmem_free(pa);
                 goto bad;
             }
+            // 每映射一页就更新，段加载到一半失败时 bad 才能把已经映射的页都释放掉
+            if (va + PAGE_SIZE > max_va) max_va = va + PAGE_SIZE;
         }
-
-        uint64 end = ph.vaddr + ph.memsz;
-        if (end > max_va) max_va = end;
     }
 
     *out_pagetable = pagetable;
@@ -146,12 +146,12 @@ uint64 exec(char *path, char **argv) {
 
     // 3. 分配用户栈 (User Stack)
     // 栈顶设在 MAX_USER_VA
-    // 我们分配 1 页作为栈
+    // 先分配最高的 1 页放参数，更深的栈在缺页时往下长（见 vmem_stack_grow）
     uint64 stack_base = MAX_USER_VA - PAGE_SIZE;
-    char *stack_pa = kmem_alloc();
+    char *stack_pa = kmem_try_alloc();
     if (!stack_pa) goto bad;
 
-    if (vmem_map_pagetable(new_pagetable, stack_base, (uint64)stack_pa, PTE_U | PTE_R | PTE_W) != 0) {
+    if (vmem_map_try(new_pagetable, stack_base, (uint64)stack_pa, PTE_U | PTE_R | PTE_W) != 0) {
         kmem_free(stack_pa);
         goto bad;
     }
@@ -201,10 +201,14 @@ uint64 exec(char *path, char **argv) {
 
     // 5. 映射 Trampoline 和 Trapframe
     // 这里的逻辑和之前一样
-    vmem_map_pagetable(new_pagetable, TRAMPOLINE, (uint64)trampoline, PTE_X | PTE_R);
-    vmem_map_pagetable(new_pagetable, TRAPFRAME, (uint64)p->trapframe, PTE_W | PTE_R);
+    if (vmem_map_try(new_pagetable, TRAMPOLINE, (uint64)trampoline, PTE_X | PTE_R) != 0)
+        goto bad;
+    if (vmem_map_try(new_pagetable, TRAPFRAME, (uint64)p->trapframe, PTE_W | PTE_R) != 0)
+        goto bad;
 
     // 6. 提交修改 (Commit Point)
+    // 旧地址空间里的 mmap 映射先解除，共享映射写过的页写回文件
+    vma_unmap_all(p);
     old_pagetable = p->pagetable;
     old_sz = p->size;
 
@@ -93,6 +93,8 @@ int file_read(struct file *f, uint64 addr, int n) {
     }
     if (f->type == FD_INODE) {
         // 普通文件读取
+        // 先把用户缓冲区缺页调进来，拿着 inode 锁时再缺页就可能要等另一个文件的锁
+        vmem_user_prefault(proc_running()->pagetable, addr, n, 1);
         fs_inode_lock(f->ip);
         fs_inode_read(f->ip);
         r = fs_inode_read_data(f->ip, 1, (char *) addr, f->off, n);
@@ -124,11 +126,13 @@ int file_write(struct file *f, uint64 addr, int n) {
     }
     if (f->type == FD_INODE) {
         // 普通文件写入
-        // 限制最大文件大小 (防止写爆磁盘)
-        int max = ((MAXFILE * BSIZE) - f->off);
+        // 限制最大文件大小：块数上限和 32 位的 size 取小的那个
+        uint64 max = MAXFILE_BYTES < 0xffffffffUL ? MAXFILE_BYTES : 0xffffffffUL;
+        max = f->off < max ? max - f->off : 0;
         if (n > max)
             n = max;
 
+        vmem_user_prefault(proc_running()->pagetable, addr, n, 0);
         fs_inode_lock(f->ip);
         fs_inode_read(f->ip);
         // fs_inode_write_data 需要支持 is_user_addr = 1
@@ -152,6 +156,7 @@ int file_stat(struct file *f, uint64 addr) {
         st.ino = f->ip->inum;
         st.type = f->ip->type;
         st.nlink = f->ip->nlink;
+        st.flags = f->ip->flags;
         st.size = f->ip->size;
         fs_inode_unlock(f->ip);
 
@@ -1,4 +1,5 @@
 #include "../include/fs.h"
+#include "../include/kalloc.h"
 #include "../include/param.h"
 #include "../include/printf.h"
 #include "../include/proc.h"
@@ -11,6 +12,14 @@
 // 全局的超级块副本，读入后常驻内存
 struct superblock sb;
 
+// 空闲块/inode 计数变了，还没写进日志
+static int sb_dirty = 0;
+
+static void fs_balloc_init(void);
+static void fs_ialloc_init(void);
+static void fs_counts_init(uint dev, int replayed);
+static void fs_bmap_cache_clear(struct inode *ip);
+
 // 读取超级块
 static void fs_read_superblock(int dev) {
     struct fsbuf *bp;
@@ -25,19 +34,31 @@ static void fs_read_superblock(int dev) {
 // 文件系统初始化：初始化块缓存，读取超级块并且校验
 void fs_init(int dev, int debug) {
     fsbuf_init();
+    fs_inode_init();
+    pcache_init();
     fs_read_superblock(dev);
-    fslog_init(dev, &sb, debug);
+    // 旧布局的超级块里没有 imapstart 这些字段，先拦下来
+    if (sb.magic == FSMAGIC && (sb.flags & FS_FLAGS_REQUIRED) != FS_FLAGS_REQUIRED)
+        panic("fs_init: old disk layout, rebuild fs.img with mkfs");
+    if (sb.magic == FSMAGIC && sb.bsize != BSIZE)
+        panic("fs_init: block size mismatch, rebuild fs.img with the same FSBSIZE");
+    int replayed = fslog_init(dev, &sb, debug);
+    fs_balloc_init();
+    fs_ialloc_init();
+    fs_counts_init(dev, replayed);
     // 2. 校验魔数
     if (sb.magic == FSMAGIC) {
         if (debug) {
             printf("fs_init: superblock loaded successfully.\n");
             printf("    magic: 0x%x\n", sb.magic);
-            printf("    size: %d blocks\n", sb.size);
+            printf("    size: %d blocks of %d bytes\n", sb.size, sb.bsize);
             printf("    inodes num: %d\n", sb.ninodes);
             printf("    inode start: block %d\n", sb.inodestart);
+            printf("    imap start: block %d\n", sb.imapstart);
             printf("    bmap start: block %d\n", sb.bmapstart);
             printf("    log start: block %d (size: %d blocks)\n", sb.logstart, sb.nlog);
-            printf("    data blocks: %d (starting from block %d)\n", sb.nblocks, sb.bmapstart + (sb.size / BPB + 1));
+            printf("    data blocks: %d (starting from block %d)\n", sb.nblocks, sb.size - sb.nblocks);
+            printf("    journal mode: %s\n", (sb.flags & FS_FLAG_ORDERED) ? "ordered" : "data");
             // fs_test_bitmap(dev);
         }
     } else {
@@ -47,89 +68,343 @@ void fs_init(int dev, int debug) {
     printf("fs_init: file system initialized\n");
 }
 
+// 提交事务前由日志层调用：空闲计数变了就把超级块加入当前事务，
+// 和改 bitmap/inode 的那些块一起原子落盘
+void fs_sb_flush(void) {
+    if (!sb_dirty)
+        return;
+    struct fsbuf *bp = fsbuf_read(ROOTDEV, 1);
+    memmove(bp->data, &sb, sizeof(sb));
+    fslog_write(bp);
+    fsbuf_release(bp);
+    sb_dirty = 0;
+}
+
 // ================== 数据块相关 =================
 
 // 把磁盘上的某一整个块填 0
-static void fs_block_zero(uint dev, uint blockno) {
-    struct fsbuf *bp = fsbuf_read(dev, blockno);
+// is_data: 是否是普通文件的数据块，有序模式下数据块的清零不进日志
+static void fs_block_zero(uint dev, uint blockno, int is_data) {
+    struct fsbuf *bp = fsbuf_overwrite(dev, blockno); // 反正整块覆盖，不用先读盘
     memset(bp->data, 0, BSIZE);
-    fslog_write(bp);
+    if (is_data)
+        fslog_write_data(bp);
+    else
+        fslog_write(bp);
     fsbuf_release(bp);
 }
 
+// 位图分配器的内存状态，数据块 bitmap 和 inode bitmap 各一份（只有 ROOTDEV 一个设备）：
+// 每个 bitmap 块还剩多少空闲位，全满的 bitmap 块直接跳过；
+// 挂载时不数（FS_NFREE_UNKNOWN），第一次读到这个 bitmap 块时再数，大镜像挂载不用把 bitmap 全读一遍
+// cursor 是 next-fit 游标，下次从上次分配的位置往后找，而不是每次从 0 开始
+#define FS_NFREE_UNKNOWN 0xffffffff
+
+struct fs_alloc {
+    uint start; // 第一个 bitmap 块的块号
+    uint nbits; // 管多少个对象（块数或 inode 数）
+    uint nbmap; // bitmap 块数
+    uint cursor;
+    uint nfree[FS_MAXBMAP];
+};
+
+static struct fs_alloc balloc; // 数据块
+static struct fs_alloc ialloc; // inode
+
+// 64 位字里最低的 1 是第几位，x 不能为 0
+static int ctz64(uint64 x) {
+    int n = 0;
+    if ((x & 0xffffffff) == 0) { n += 32; x >>= 32; }
+    if ((x & 0xffff) == 0) { n += 16; x >>= 16; }
+    if ((x & 0xff) == 0) { n += 8; x >>= 8; }
+    if ((x & 0xf) == 0) { n += 4; x >>= 4; }
+    if ((x & 0x3) == 0) { n += 2; x >>= 2; }
+    if ((x & 0x1) == 0) { n += 1; }
+    return n;
+}
+
+// 64 位字里有几个 1
+static int popcount64(uint64 x) {
+    x = x - ((x >> 1) & 0x5555555555555555ULL);
+    x = (x & 0x3333333333333333ULL) + ((x >> 2) & 0x3333333333333333ULL);
+    x = (x + (x >> 4)) & 0x0f0f0f0f0f0f0f0fULL;
+    return (x * 0x0101010101010101ULL) >> 56;
+}
+
+// 在一个 bitmap 块里从第 from 位开始找第一个 0，一次看 64 位，没有返回 -1
+// bitmap 按字节从低位排，小端机器上正好是 uint64 的第 0..63 位
+static int fs_bitmap_find(uchar *data, uint from) {
+    uint64 *w = (uint64 *) data;
+    uint i = from / 64;
+    // 起始字里 from 之前的位当作已占用
+    uint64 x = w[i] | ((1ULL << (from % 64)) - 1);
+    for (;;) {
+        if (~x)
+            return i * 64 + ctz64(~x);
+        if (++i >= BSIZE / 8)
+            return -1;
+        x = w[i];
+    }
+}
+
+// 挂载时设置分配器，不读 bitmap
+static void fs_alloc_init(struct fs_alloc *a, uint start, uint nbits) {
+    a->start = start;
+    a->nbits = nbits;
+    a->nbmap = (nbits + BPB - 1) / BPB;
+    if (a->nbmap > FS_MAXBMAP)
+        panic("fs_alloc_init: too many bitmap blocks");
+    a->cursor = 0;
+    for (uint bm = 0; bm < a->nbmap; bm++)
+        a->nfree[bm] = FS_NFREE_UNKNOWN;
+}
+
+static void fs_balloc_init(void) {
+    fs_alloc_init(&balloc, sb.bmapstart, sb.size);
+}
+
+static void fs_ialloc_init(void) {
+    fs_alloc_init(&ialloc, sb.imapstart, sb.ninodes);
+}
+
+// 数一个 bitmap 块里的空闲位（超出 nbits 的位 mkfs 已经置 1，整块数就行）
+static uint fs_bitmap_nfree(uchar *data) {
+    uint64 *w = (uint64 *) data;
+    uint nfree = 0;
+    for (int i = 0; i < BSIZE / 8; i++)
+        nfree += 64 - popcount64(w[i]);
+    return nfree;
+}
+
+// 分配器里一共还有多少空闲位，还没数过的 bitmap 块这时读出来数
+static uint64 fs_alloc_nfree(uint dev, struct fs_alloc *a) {
+    uint64 n = 0;
+    for (uint bm = 0; bm < a->nbmap; bm++) {
+        if (a->nfree[bm] == FS_NFREE_UNKNOWN) {
+            if (bm % FSBUF_READAHEAD == 0)
+                fsbuf_readahead(dev, a->start + bm, a->nbmap - bm);
+            struct fsbuf *bp = fsbuf_read(dev, a->start + bm);
+            a->nfree[bm] = fs_bitmap_nfree(bp->data);
+            fsbuf_release(bp);
+        }
+        n += a->nfree[bm];
+    }
+    return n;
+}
+
+// 从第 from 位开始找连续的空闲位：优先找长度够 want 的一段，找不到就返回最长的一段
+// limit 是这个 bitmap 块里有效的位数，*len 返回这段的长度，没有空闲位返回 -1
+static int fs_bitmap_run(uchar *data, uint from, uint limit, uint want, uint *len) {
+    int best = -1;
+    uint best_len = 0;
+    while (from < limit) {
+        int bi = fs_bitmap_find(data, from);
+        if (bi < 0 || bi >= limit)
+            break;
+        uint l = 1;
+        while (l < want && bi + l < limit && !(data[(bi + l) / 8] & (1 << ((bi + l) % 8))))
+            l++;
+        if (l > best_len) {
+            best = bi;
+            best_len = l;
+        }
+        if (l >= want)
+            break;
+        from = bi + l;
+    }
+    *len = best_len;
+    return best;
+}
+
+// 从第 from 个对象开始找最多 want 个连续的空闲位并标记占用，*got 返回实际找到几个（至少 1）
+// 返回第一个的编号，没有空闲位返回 -1。游标由调用者更新
+static int fs_alloc_run(uint dev, struct fs_alloc *a, uint from, uint want, uint *got) {
+    // 从 from 所在的 bitmap 块开始往后找，最多绕一圈回到起点
+    // 起点块第一次只看 from 之后的部分，绕回来时再从头看
+    for (uint k = 0; k <= a->nbmap; k++) {
+        uint bm = (from / BPB + k) % a->nbmap;
+        if (a->nfree[bm] == 0)
+            continue; // 整块都满了，不用读
+        uint lo = k == 0 ? from % BPB : 0;
+        uint limit = min(BPB, a->nbits - bm * BPB);
+
+        struct fsbuf *bp = fsbuf_read(dev, a->start + bm);
+        if (a->nfree[bm] == FS_NFREE_UNKNOWN)
+            a->nfree[bm] = fs_bitmap_nfree(bp->data);
+        uint len;
+        int bi = fs_bitmap_run(bp->data, lo, limit, want, &len);
+        if (bi < 0) {
+            fsbuf_release(bp);
+            continue;
+        }
+        // 找到空闲的位，标记被占用，写回 Bitmap (持久化分配状态)
+        for (uint i = bi; i < bi + len; i++)
+            bp->data[i / 8] |= 1 << (i % 8);
+        fslog_write(bp);
+        fsbuf_release(bp);
+
+        a->nfree[bm] -= len;
+        *got = len;
+        return bm * BPB + bi;
+    }
+    return -1;
+}
+
+// 分配最多 want 个物理连续的块，在 bitmap 上标记，*got 返回实际分到几块（至少 1）
+// 返回第一块的块号。新块不清零，调用者要么整块覆盖，要么自己在 buffer 里清零
+static uint fs_block_alloc_run(uint dev, uint want, uint *got) {
+    int blockno = fs_alloc_run(dev, &balloc, balloc.cursor, want, got);
+    if (blockno < 0)
+        panic("fs_block_alloc: out of blocks");
+    sb.nfree_blocks -= *got;
+    sb_dirty = 1;
+    balloc.cursor = blockno + *got < sb.size ? blockno + *got : 0;
+    return blockno;
+}
+
 // 分配一个清0的磁盘块，在bitmap上标记，返回分配的块号
+static uint fs_block_alloc_for(uint dev, int is_data) {
+    uint got;
+    uint blockno = fs_block_alloc_run(dev, 1, &got);
+    // 清零新块的内容
+    fs_block_zero(dev, blockno, is_data);
+    return blockno;
+}
+
+// 分配一个元数据块（间接块、目录块）
 uint fs_block_alloc(uint dev) {
-    // 遍历所有的 Bitmap 块 (通常就 1 个，大磁盘会有多个)。
-    // 在每个 Bitmap 块里，遍历每一位 (0 ~ 8191)。
-    // 找到第一个为 0 的位。
-    // 算出对应的物理块号 blockno。
-    // 将该位改为 1，写回 Bitmap。
-    // 调用 fs_block_zero 清空该物理块。
-    // 返回块号。
-    struct fsbuf *bp;
-    for (int b = 0; b < sb.size; b++) {
-        // 读取当前范围对应的 bitmap 块
-        bp = fsbuf_read(dev, BBLOCK(b, sb));
-        for (int bi = 0; bi < BPB && b + bi < sb.size; bi++) {
-            int byte_idx = bi / 8;
-            int m = 1 << (bi % 8); // 生成掩码
-            int is_used = bp->data[byte_idx] & m;
-            // 检查该位是否为 0 (空闲)
-            if (!is_used) {
-                // 找到空闲的位，标记被占用
-                bp->data[byte_idx] |= m;
-                // 写回 Bitmap (持久化分配状态)
-                fslog_write(bp);
-                fsbuf_release(bp);
-                // 算出块号
-                uint blockno = b + bi;
-                // 清零新块的内容
-                fs_block_zero(dev, blockno);
-                return blockno;
+    return fs_block_alloc_for(dev, 0);
+}
+
+// 块号升序排序（插入排序：从间接块里收集的块号通常本来就基本有序）
+static void fs_sort_blocks(uint *b, int n) {
+    for (int i = 1; i < n; i++) {
+        uint x = b[i];
+        int j = i;
+        for (; j > 0 && b[j - 1] > x; j--)
+            b[j] = b[j - 1];
+        b[j] = x;
+    }
+}
+
+// 批量释放一组编号：排好序后同一个 bitmap 块里的位一次清完，每个 bitmap 块只读、只记日志一次
+static void fs_alloc_free(uint dev, struct fs_alloc *a, uint *bits, int n) {
+    fs_sort_blocks(bits, n);
+    for (int i = 0; i < n;) {
+        uint bm = bits[i] / BPB;
+        struct fsbuf *bp = fsbuf_read(dev, a->start + bm);
+        for (; i < n && bits[i] / BPB == bm; i++) {
+            // 计算在当前 bitmap 块内的位偏移
+            uint bi = bits[i] % BPB;
+            // 生成掩码
+            int m = 1 << (bi % 8);
+            // 如果该位已经是 0，说明被重复释放了
+            if ((bp->data[bi / 8] & m) == 0) {
+                panic("fs_alloc_free: freeing free bit");
             }
+            // 将该位改为 0
+            bp->data[bi / 8] &= ~m;
+            if (a->nfree[bm] != FS_NFREE_UNKNOWN)
+                a->nfree[bm]++;
         }
-        // 当前 bitmap 块满了，释放它，继续找下一个 bitmap 块
+        // 写回 Bitmap
+        fslog_write(bp);
         fsbuf_release(bp);
     }
-    panic("fs_block_alloc: out of blocks");
-    return 0;
+}
+
+// 批量释放一组磁盘块
+void fs_block_free_vec(uint dev, uint *blocks, int n) {
+    fs_alloc_free(dev, &balloc, blocks, n);
+    sb.nfree_blocks += n;
+    sb_dirty = 1;
 }
 
 // 释放一个磁盘块
 void fs_block_free(uint dev, uint blockno) {
-    struct fsbuf *bp;
-    bp = fsbuf_read(dev, BBLOCK(blockno, sb));
-    // 计算在当前 bitmap 块内的位偏移
-    uint bi = blockno % BPB;
-    // 生成掩码
-    int m = 1 << (bi % 8);
-    // 如果该位已经是 0，说明被重复释放了
-    if ((bp->data[bi / 8] & m) == 0) {
-        panic("fs_block_free: freeing free block");
-    }
-    // 将该位改为 0，写回 Bitmap
-    bp->data[bi / 8] &= ~m;
-    fslog_write(bp);
-    fsbuf_release(bp);
+    fs_block_free_vec(dev, &blockno, 1);
 }
 
 // ================== Inode 相关 =================
 
 // 全局的 Inode 缓存表
+// 按 (dev, inum) 哈希查找；引用计数降到 0 但内容有效的 inode 不马上丢，
+// 挂在 LRU 上，下次 get 命中就不用再读盘，槽位不够时才从 LRU 尾部回收
+// 槽位按需从物理页里切，总数上限在初始化时按空闲内存算出来
 struct {
     // struct spinlock lock; // 单核简版暂时不用锁
-    struct inode inode[NINODE];
+    struct inode *hash[ITABLE_HASH];
+    struct inode lru; // LRU 哨兵，lru.lru_next 是最近用过的
+    struct inode *free; // 空闲槽位（回收的）
+    char *page; // 正在切的页
+    int page_left; // 这页还能切几个
+    uint n; // 已经切出来的槽位数
+    uint max; // 槽位上限
 } itable;
 
 // 初始化 Inode 缓存表
 void fs_inode_init() {
-    // 锁初始化可以省略
-    // 内存清零通常由 bss 段自动完成
-    for (int i = 0; i < NINODE; i++) {
-        itable.inode[i].ref = 0;
-        itable.inode[i].valid = 0;
-        sleeplock_init(&itable.inode[i].lock, "inode");
+    itable.lru.lru_next = itable.lru.lru_prev = &itable.lru;
+    itable.free = 0;
+    itable.page = 0;
+    itable.page_left = 0;
+    itable.n = 0;
+    uint per_page = PAGE_SIZE / sizeof(struct inode);
+    itable.max = kmem_free_pages() / ITABLE_MEM_FRACTION * per_page;
+    if (itable.max < per_page)
+        itable.max = per_page;
+    printf("fs_inode_init: inode cache up to %d entries\n", itable.max);
+}
+
+static struct inode **itable_bucket(uint dev, uint inum) {
+    return &itable.hash[(dev * 31 + inum) % ITABLE_HASH];
+}
+
+static void itable_lru_remove(struct inode *ip) {
+    ip->lru_prev->lru_next = ip->lru_next;
+    ip->lru_next->lru_prev = ip->lru_prev;
+    ip->lru_next = ip->lru_prev = 0;
+}
+
+static void itable_hash_remove(struct inode *ip) {
+    struct inode **pp = itable_bucket(ip->dev, ip->inum);
+    while (*pp != ip)
+        pp = &(*pp)->hnext;
+    *pp = ip->hnext;
+    ip->hnext = 0;
+}
+
+// 拿一个没人用的槽位：先用回收的，再切新的，到上限了就回收 LRU 最久没用的
+// 还有脏页没写回的 inode 不能回收，跳过；全都脏就超出上限再切一个
+static struct inode *itable_slot() {
+    struct inode *ip;
+    if (itable.free) {
+        ip = itable.free;
+        itable.free = ip->hnext;
+        return ip;
     }
+    for (ip = itable.lru.lru_prev; ip != &itable.lru && itable.n >= itable.max; ip = ip->lru_prev) {
+        if (pcache_evict(ip) == 0) {
+            itable_lru_remove(ip);
+            itable_hash_remove(ip);
+            return ip;
+        }
+    }
+    if (itable.n < itable.max || itable.lru.lru_prev != &itable.lru) {
+        if (itable.page_left == 0) {
+            itable.page = kmem_alloc();
+            itable.page_left = PAGE_SIZE / sizeof(struct inode);
+        }
+        ip = (struct inode *) itable.page;
+        itable.page += sizeof(struct inode);
+        itable.page_left--;
+        itable.n++;
+        sleeplock_init(&ip->lock, "inode");
+        return ip;
+    }
+    // 所有 inode 都有人在用
+    panic("fs_inode_get: no inodes");
+    return 0;
 }
 
 void fs_inode_lock(struct inode *ip) {
@@ -138,6 +413,8 @@ void fs_inode_lock(struct inode *ip) {
         return;
     }
     sleeplock_acquire(&ip->lock);
+    if (proc_running())
+        proc_running()->ilocks++;
     // 获取锁之后，如果发现数据还没读进来，顺便读一下
     if (ip->valid == 0) {
         fs_inode_read(ip);
@@ -147,38 +424,38 @@ void fs_inode_lock(struct inode *ip) {
 void fs_inode_unlock(struct inode *ip) {
     if (ip == 0 || ip->ref < 0)
         panic("fs_inode_unlock");
+    if (proc_running())
+        proc_running()->ilocks--;
     sleeplock_release(&ip->lock);
 }
 
 // 获取内存 inode (引用计数 +1)，相当于fsbuf_get()，只处理缓存相关的东西，真正从磁盘读取由read()执行
 struct inode *fs_inode_get(uint dev, uint inum) {
-    struct inode *ip, *empty;
+    struct inode *ip;
+    struct inode **bucket = itable_bucket(dev, inum);
 
     // 1. 先找找是不是已经在缓存里了
-    empty = 0;
-    for (int i = 0; i < NINODE; i++) {
-        ip = &itable.inode[i];
-        if (ip->ref > 0 && ip->dev == dev && ip->inum == inum) {
-            // 缓存命中
+    for (ip = *bucket; ip; ip = ip->hnext) {
+        if (ip->dev == dev && ip->inum == inum) {
+            // 缓存命中，没人引用的要从 LRU 上摘下来
+            if (ip->ref == 0)
+                itable_lru_remove(ip);
             ip->ref++;
             return ip;
         }
-        // 顺手找一个空位
-        if (empty == 0 && ip->ref == 0)
-            empty = ip;
     }
 
     // 2. 没缓存，分配一个新槽位
-    if (empty == 0) {
-        // inode 缓存满了
-        panic("fs_inode_get: no inodes");
-        return 0;
-    }
-    ip = empty;
+    ip = itable_slot();
     ip->dev = dev;
     ip->inum = inum;
     ip->ref = 1;
     ip->valid = 0; // 标记为无效，等 iread 时再读盘
+    ip->ra_end = 0;
+    ip->dir_free = 0;
+    fs_bmap_cache_clear(ip);
+    ip->hnext = *bucket;
+    *bucket = ip;
     return ip;
 }
 
@@ -209,6 +486,7 @@ void fs_inode_read(struct inode *ip) {
     ip->major = dip->major;
     ip->minor = dip->minor;
     ip->nlink = dip->nlink;
+    ip->flags = dip->flags;
     ip->size = dip->size;
     memmove(ip->addrs, dip->addrs, sizeof(ip->addrs));
     // 释放缓冲区
@@ -232,6 +510,7 @@ void fs_inode_write(struct inode *ip) {
     dip->major = ip->major;
     dip->minor = ip->minor;
     dip->nlink = ip->nlink;
+    dip->flags = ip->flags;
     dip->size = ip->size;
     memmove(dip->addrs, ip->addrs, sizeof(ip->addrs));
 
@@ -239,122 +518,381 @@ void fs_inode_write(struct inode *ip) {
     fsbuf_release(bp); // 释放缓冲区
 }
 
-// 返回 inode ip 的第 bn 个逻辑块对应的磁盘物理块号
-// 如果该块不存在，会分配它 (allocate)
-uint fs_inode_map(struct inode *ip, uint bn) {
-    uint addr, *a;
+// 把逻辑块号拆成间接块路径：返回级数（0 是直接块，1~3 是几级间接块，超出范围返回 -1）
+// idx[0..level-1] 是从 addrs[NDIRECT + level - 1] 往下，每一层间接块里的下标
+static int fs_bmap_path(uint bn, uint *idx) {
+    if (bn < NDIRECT)
+        return 0;
+    bn -= NDIRECT;
+
+    // 先找出落在第几级：每一级能覆盖的块数是上一级的 NINDIRECT 倍
+    uint span = NINDIRECT;
+    int level = 1;
+    while (bn >= span) {
+        bn -= span;
+        if (++level > 3)
+            return -1;
+        span *= NINDIRECT;
+    }
+
+    // 再按 NINDIRECT 进制拆出每一层的下标
+    for (int k = 0; k < level; k++) {
+        span /= NINDIRECT;
+        idx[k] = bn / span;
+        bn %= span;
+    }
+    return level;
+}
+
+// 清空块映射缓存：inode 换了身份或者块被释放时调用
+static void fs_bmap_cache_clear(struct inode *ip) {
+    ip->map_len = 0;
+    ip->ind_addr = 0;
+}
+
+// 间接块覆盖部分的映射：先查连续段缓存，再看最底层间接块是不是刚用过的那个，
+// 都不中才从 inode 往下逐层走；alloc 为真时缺的块现场分配（give 不为 0 时数据块就用 give），
+// 否则空洞返回 0
+// 顺序读写时一个间接块只需要读一次，后面的块直接由连续段算出来
+static uint fs_bmap_indirect(struct inode *ip, uint bn, int level, uint *idx, int alloc, uint give) {
+    uint addr;
     struct fsbuf *bp;
+    int is_data = ip->type != T_DIR;
+
+    if (ip->map_len && bn - ip->map_lbn < ip->map_len)
+        return ip->map_pbn + (bn - ip->map_lbn);
+
+    // 1. 找最底层的间接块
+    uint i = idx[level - 1];
+    uint ind_lbn = bn - i;
+    uint ind = ip->ind_addr && ip->ind_lbn == ind_lbn ? ip->ind_addr : 0;
+    if (ind == 0) {
+        // 顶层的间接块挂在 inode 上，没有就分配
+        if ((addr = ip->addrs[NDIRECT + level - 1]) == 0) {
+            if (!alloc)
+                return 0;
+            addr = fs_block_alloc(ip->dev);
+            ip->addrs[NDIRECT + level - 1] = addr;
+            fs_inode_write(ip);
+        }
+        // 一层层往下走到最底层，缺的中间间接块现场分配
+        for (int k = 0; k < level - 1; k++) {
+            bp = fsbuf_read(ip->dev, addr);
+            uint *a = (uint *) bp->data;
+            if ((addr = a[idx[k]]) == 0 && alloc) {
+                addr = fs_block_alloc(ip->dev);
+                a[idx[k]] = addr;
+                fslog_write(bp); // 间接块内容变了，写回
+            }
+            fsbuf_release(bp);
+            if (addr == 0)
+                return 0;
+        }
+        ind = addr;
+        ip->ind_lbn = ind_lbn;
+        ip->ind_addr = ind;
+    }
+
+    // 2. 读最底层间接块里的项
+    bp = fsbuf_read(ip->dev, ind);
+    uint *a = (uint *) bp->data;
+    if ((addr = a[i]) == 0 && alloc) {
+        addr = give ? give : fs_block_alloc_for(ip->dev, is_data);
+        a[i] = addr;
+        fslog_write(bp);
+        // 新块接在缓存的连续段后面，段就往后长一块
+        if (ip->map_len && bn == ip->map_lbn + ip->map_len && addr == ip->map_pbn + ip->map_len) {
+            ip->map_len++;
+            fsbuf_release(bp);
+            return addr;
+        }
+    }
+    if (addr != 0) {
+        // 顺着这个间接块往后看，物理上连续的都记进连续段
+        uint len = 1;
+        while (i + len < NINDIRECT && a[i + len] == addr + len)
+            len++;
+        ip->map_lbn = bn;
+        ip->map_pbn = addr;
+        ip->map_len = len;
+    }
+    fsbuf_release(bp);
+    return addr;
+}
+
+// 内联 inode 转成块映射：内容搬到新分配的第 0 块，addrs 清空后当块号用
+// mmap 文件前也要先转：页缓存只认块映射，调用者持有 inode 锁且在事务里
+void fs_inline_to_blocks(struct inode *ip) {
+    char data[FS_INLINE_MAX];
+    memmove(data, ip->addrs, sizeof(data));
+    memset(ip->addrs, 0, sizeof(ip->addrs));
+    ip->flags &= ~I_INLINE;
+    fs_bmap_cache_clear(ip);
+
+    if (ip->size > 0 && ip->type == T_FILE) {
+        // 普通文件的数据交给页缓存，和以后的写一样分配块、提交前写回
+        pcache_write(ip, 0, data, 0, ip->size);
+    } else if (ip->size > 0) {
+        uint got;
+        uint addr = fs_block_alloc_run(ip->dev, 1, &got);
+        ip->addrs[0] = addr;
+        struct fsbuf *bp = fsbuf_overwrite(ip->dev, addr);
+        memset(bp->data, 0, BSIZE);
+        memmove(bp->data, data, ip->size);
+        fslog_write(bp);
+        fsbuf_release(bp);
+    }
+    fs_inode_write(ip);
+}
+
+// 返回 inode ip 的第 bn 个逻辑块对应的磁盘物理块号
+// 如果该块不存在：give 为 0 就分配一个清零的新块，否则映射到调用者已经分配好的 give
+static uint fs_inode_assign(struct inode *ip, uint bn, uint give) {
+    uint addr, idx[3];
+
+    if (ip->flags & I_INLINE)
+        fs_inline_to_blocks(ip);
+
+    // 目录内容属于元数据，必须走日志；普通文件的数据块在有序模式下不进日志
+    int is_data = ip->type != T_DIR;
+
+    int level = fs_bmap_path(bn, idx);
+    if (level < 0)
+        panic("fs_inode_assign: out of range");
 
     // 1. 直接块
-    if (bn < NDIRECT) {
+    if (level == 0) {
         if ((addr = ip->addrs[bn]) == 0) {
             // 如果还没分配，分配一个新块
-            addr = fs_block_alloc(ip->dev);
+            addr = give ? give : fs_block_alloc_for(ip->dev, is_data);
             ip->addrs[bn] = addr;
             fs_inode_write(ip); // 更新 inode (因为 addrs 变了)
         }
         return addr;
     }
 
-    // 2. 一级间接块
-    bn -= NDIRECT; // 调整索引，0 对应间接块里的第 0 项
-
-    if (bn < NINDIRECT) {
-        // 2.1 检查间接块本身是否存在，没有就分配
-        if ((addr = ip->addrs[NDIRECT]) == 0) {
-            addr = fs_block_alloc(ip->dev);
-            ip->addrs[NDIRECT] = addr;
-            fs_inode_write(ip);
-        }
+    // 2. 间接块
+    return fs_bmap_indirect(ip, bn, level, idx, 1, give);
+}
 
-        // 2.2 读取间接块的内容
-        bp = fsbuf_read(ip->dev, addr);
-        a = (uint *) bp->data; // 当作数组
+// 返回 inode ip 的第 bn 个逻辑块对应的磁盘物理块号
+// 如果该块不存在，会分配它 (allocate)
+uint fs_inode_map(struct inode *ip, uint bn) {
+    return fs_inode_assign(ip, bn, 0);
+}
 
-        // 2.3 检查目标数据块是否存在，没有就分配
-        if ((addr = a[bn]) == 0) {
-            addr = fs_block_alloc(ip->dev);
-            a[bn] = addr;
-            fslog_write(bp); // 间接块内容变了，写回
-        }
-        fsbuf_release(bp); // 记得释放
-        return addr;
-    }
+// 和 fs_inode_map 一样查物理块号，但不分配，空洞返回 0
+uint fs_inode_bmap(struct inode *ip, uint bn) {
+    uint idx[3];
+    if (ip->flags & I_INLINE)
+        return 0; // 内联的 inode 没有数据块
+    int level = fs_bmap_path(bn, idx);
+    if (level <= 0)
+        return level == 0 ? ip->addrs[bn] : 0;
+    return fs_bmap_indirect(ip, bn, level, idx, 0, 0);
+}
 
-    panic("fs_inode_map: out of range");
-    return 0;
+// 给逻辑块 [bn, bn + want) 这段空洞分配物理连续的一段块，返回起始块号，*got 是实际分到几块
+// 新块不清零，由调用者（页缓存）整块写满
+uint fs_inode_alloc_run(struct inode *ip, uint bn, uint want, uint *got) {
+    uint addr = fs_block_alloc_run(ip->dev, want, got);
+    for (uint k = 0; k < *got; k++)
+        fs_inode_assign(ip, bn + k, addr + k);
+    return addr;
 }
 
 // 分配一个新的磁盘 inode，返回内存inode
+// near: 尽量分配在这个 inode 附近（比如父目录，同一个 inode 块里目录扫描时少读盘），0 表示不指定
+struct inode *fs_inode_alloc_near(uint dev, short type, uint near) {
+    uint start = (near > 0 && near < sb.ninodes) ? near : ialloc.cursor;
+    uint got;
+    int inum = fs_alloc_run(dev, &ialloc, start, 1, &got);
+    if (inum <= 0)
+        panic("fs_inode_alloc: no inodes available");
+
+    struct fsbuf *bp = fsbuf_read(dev, IBLOCK(inum, sb)); // 拿到这个inode所在的磁盘块
+    struct dinode *dip = (struct dinode *) bp->data + (inum % IPB); // 拿到 dinode 指针（理解为dinode数组）
+    if (dip->type != 0)
+        panic("fs_inode_alloc: inode bitmap out of sync");
+
+    // 清空初始化，普通文件和目录从内联开始，写多了再分配数据块
+    ushort flags = (type == T_FILE || type == T_DIR) ? I_INLINE : 0;
+    memset(dip, 0, sizeof(*dip));
+    dip->type = type; // 标记为已占用
+    dip->flags = flags;
+    fslog_write(bp); // 标记占据，写回释放
+    fsbuf_release(bp);
+    if (near == 0)
+        ialloc.cursor = inum + 1 < sb.ninodes ? inum + 1 : 1;
+    sb.nfree_inodes--;
+    sb_dirty = 1;
+
+    struct inode *ip = fs_inode_get(dev, inum);
+    fs_inode_lock(ip);
+    ip->valid = 1;
+    ip->type = type;
+    ip->major = 0;
+    ip->minor = 0;
+    ip->size = 0;
+    ip->nlink = 0;
+    ip->flags = flags;
+    memset(ip->addrs, 0, sizeof(ip->addrs));
+    fs_inode_unlock(ip);
+    return ip; // 返回内存 inode
+}
+
+// 不指定位置，从 rotor 开始找
 struct inode *fs_inode_alloc(uint dev, short type) {
-    int inum;
-    struct fsbuf *bp;
-    struct dinode *dip;
+    return fs_inode_alloc_near(dev, type, 0);
+}
 
-    // 遍历所有 inode (从 1 开始)
-    for (inum = 1; inum < sb.ninodes; inum++) {
-        bp = fsbuf_read(dev, IBLOCK(inum, sb)); // 拿到这个inode所在的磁盘块
-        dip = (struct dinode *) bp->data + (inum % IPB); // 拿到 dinode 指针（理解为dinode数组）
+// 截断时攒着待释放的块号，满了就批量释放一次
+struct fs_freeq {
+    uint dev;
+    int n;
+    uint blocks[FS_FREE_BATCH];
+};
+
+static void fs_freeq_flush(struct fs_freeq *q) {
+    if (q->n > 0)
+        fs_block_free_vec(q->dev, q->blocks, q->n);
+    q->n = 0;
+}
 
-        if (dip->type == 0) {
-            // 找到了空闲位，清空初始化
-            memset(dip, 0, sizeof(*dip));
-            dip->type = type; // 标记为已占用
-            fslog_write(bp); // 标记占据，写回释放
-            fsbuf_release(bp);
+static void fs_freeq_add(struct fs_freeq *q, uint blockno) {
+    if (q->n == FS_FREE_BATCH)
+        fs_freeq_flush(q);
+    q->blocks[q->n++] = blockno;
+}
 
-            struct inode *ip = fs_inode_get(dev, inum);
-            fs_inode_lock(ip);
-            ip->valid = 1;
-            ip->type = type;
-            ip->major = 0;
-            ip->minor = 0;
-            ip->size = 0;
-            ip->nlink = 0;
-            memset(ip->addrs, 0, sizeof(uint) * ((NDIRECT + 1)));
-            fs_inode_unlock(ip);
-            return ip; // 返回内存 inode
+// 截断过程中日志要留的余量：清零间接块指针、写 inode、超级块，以及删除时的 inode bitmap
+#define FS_TRUNC_SLACK 8
+
+// 日志剩下的位置还够不够再往前释放一步：攒着的每个块号释放时最多改一个 bitmap 块
+static int fs_trunc_low(struct fs_freeq *q) {
+    return fslog_room() < q->n + FS_TRUNC_SLACK;
+}
+
+// 截断到一个一致的中间状态并提交：inode 不再引用已释放的块，size 也缩到剩下的部分
+static void fs_trunc_checkpoint(struct inode *ip, struct fs_freeq *q, uint keep_blocks) {
+    fs_freeq_flush(q);
+    if (ip->size > keep_blocks * BSIZE)
+        ip->size = keep_blocks * BSIZE;
+    fs_inode_write(ip);
+    fslog_commit();
+}
+
+// 释放第 level 级间接块 addr 和它下面挂着的所有块，base 是它管的第一个逻辑块
+// 从后往前释放，日志快满时把已释放部分的指针清掉再提交，文件始终是原来的一个前缀，
+// 一棵树多大、散在多少个 bitmap 块里都不受日志大小限制
+static void fs_free_indirect(struct inode *ip, struct fs_freeq *q, uint addr, int level, uint base) {
+    uint span = 1;
+    for (int k = 1; k < level; k++)
+        span *= NINDIRECT;
+
+    for (int j = NINDIRECT - 1; j >= 0; j--) {
+        // 每一项都重新读：下一层里可能提交过，提交要锁日志里的 buffer，这里不能一直拿着
+        struct fsbuf *bp = fsbuf_read(q->dev, addr);
+        uint *a = (uint *) bp->data;
+        uint child = a[j];
+        if (child == 0) {
+            fsbuf_release(bp);
+            continue;
+        }
+        if (level > 1) {
+            fsbuf_release(bp);
+            fs_free_indirect(ip, q, child, level - 1, base + j * span);
+            // 子树整个释放了，指针马上清掉，之后任何时候提交都是一致的
+            bp = fsbuf_read(q->dev, addr);
+            a = (uint *) bp->data;
+            a[j] = 0;
+            fslog_write(bp);
+        } else {
+            fs_freeq_add(q, child);
+        }
+        if (fs_trunc_low(q)) {
+            // 一级间接块里 j 往后的指针还没清，清掉再提交
+            if (level == 1) {
+                memset(a + j, 0, (NINDIRECT - j) * sizeof(uint));
+                fslog_write(bp);
+            }
+            fsbuf_release(bp);
+            fs_trunc_checkpoint(ip, q, base + j * span);
+        } else {
+            fsbuf_release(bp);
         }
-        fsbuf_release(bp);
     }
-    panic("fs_inode_alloc: no inodes available");
-    return 0;
+
+    // 最后释放间接块本身
+    fs_freeq_add(q, addr);
 }
 
 // 将 inode 占用的所有数据块释放，并将大小设为 0
+// 从三级间接块往前释放，日志快满时停在一个一致状态先提交，文件始终是原来的一个前缀
 void fs_inode_trunc(struct inode *ip) {
-    int i, j;
-    struct fsbuf *bp;
-    uint *a;
+    int i;
+    struct fs_freeq q;
+    q.dev = ip->dev;
+    q.n = 0;
+    fs_bmap_cache_clear(ip);
+    // 缓存的页可能还要写回这些块，先全部丢掉
+    if (ip->type == T_FILE)
+        pcache_truncate(ip);
+
+    // 内联的 inode 没有块可释放，清掉内容就行
+    if (ip->flags & I_INLINE) {
+        memset(ip->addrs, 0, sizeof(ip->addrs));
+        ip->size = 0;
+        fs_inode_write(ip);
+        return;
+    }
+
+    // 当前事务剩的位置太少就先把前面的改动提交掉
+    if (fs_trunc_low(&q))
+        fslog_commit();
+
+    // 0. 预读要改的 bitmap 块，后面逐批释放时都能命中缓存
+    uint lo = 0, hi = 0;
+    for (i = 0; i < NADDRS; i++) {
+        uint addr = ip->addrs[i];
+        if (addr == 0)
+            continue;
+        if (lo == 0 || addr < lo)
+            lo = addr;
+        if (addr > hi)
+            hi = addr;
+    }
+    if (lo != 0)
+        fsbuf_readahead(ip->dev, BBLOCK(lo, sb), BBLOCK(hi, sb) - BBLOCK(lo, sb) + 1);
 
-    // 1. 释放直接块
-    for (i = 0; i < NDIRECT; i++) {
+    // 1. 释放三级、二级、一级间接块
+    for (i = NADDRS - 1; i >= NDIRECT; i--) {
         if (ip->addrs[i]) {
-            fs_block_free(ip->dev, ip->addrs[i]);
+            // 这棵树管的第一个逻辑块，也就是释放后文件最多还剩多少块
+            uint first = i == NDIRECT ? NDIRECT : i == NDIRECT + 1 ? NDIRECT + NINDIRECT : NDIRECT + NINDIRECT + NDINDIRECT;
+            fs_free_indirect(ip, &q, ip->addrs[i], i - NDIRECT + 1, first);
             ip->addrs[i] = 0;
+            if (fs_trunc_low(&q))
+                fs_trunc_checkpoint(ip, &q, first);
         }
     }
 
-    // 2. 释放间接块
-    if (ip->addrs[NDIRECT]) {
-        // 先读出间接块的内容，因为里面存着要释放的块号
-        bp = fsbuf_read(ip->dev, ip->addrs[NDIRECT]);
-        a = (uint *) bp->data;
-
-        for (j = 0; j < NINDIRECT; j++) {
-            if (a[j])
-                fs_block_free(ip->dev, a[j]);
+    // 2. 释放直接块
+    for (i = NDIRECT - 1; i >= 0; i--) {
+        if (ip->addrs[i]) {
+            fs_freeq_add(&q, ip->addrs[i]);
+            ip->addrs[i] = 0;
+            if (fs_trunc_low(&q))
+                fs_trunc_checkpoint(ip, &q, i);
         }
-
-        fsbuf_release(bp); // 释放间接块的缓存
-
-        // 最后释放间接块本身
-        fs_block_free(ip->dev, ip->addrs[NDIRECT]);
-        ip->addrs[NDIRECT] = 0;
     }
+    fs_freeq_flush(&q);
 
-    // 3. 更新 inode 元数据
+    // 3. 更新 inode 元数据，普通文件和目录空了就回到内联
     ip->size = 0;
+    ip->ra_end = 0;
+    if (ip->type == T_FILE || ip->type == T_DIR)
+        ip->flags |= I_INLINE;
     fs_inode_write(ip); // 写回磁盘
 }
 
@@ -366,16 +904,36 @@ void fs_inode_release(struct inode *ip) {
         // 触发彻底删除逻辑：
         // 释放所有数据块
         fs_inode_trunc(ip);
+        // 目录的 inum 马上可能被复用，挂在它下面的缓存项都作废
+        if (ip->type == T_DIR)
+            dcache_purge_dir(ip->dev, ip->inum);
         // 标记 inode 为空闲 (type = 0)
         ip->type = 0;
         fs_inode_write(ip);
+        uint inum = ip->inum;
+        fs_alloc_free(ip->dev, &ialloc, &inum, 1);
+        sb.nfree_inodes++;
+        sb_dirty = 1;
         ip->valid = 0; // 内存缓存也标记无效
     }
 
     ip->ref--;
     fs_inode_unlock(ip);
     // 如果 ref > 0，说明还有别人在用，我们只是减少引用
-    // 如果 ref == 0，这个槽位现在空闲了，可以被 iget 复用
+    // 如果 ref == 0：内容还有效就挂到 LRU 头上留着，下次 get 直接命中；
+    // 已经删掉的 inode 没有保留的价值，槽位直接回收
+    if (ip->ref == 0) {
+        if (ip->valid) {
+            ip->lru_next = itable.lru.lru_next;
+            ip->lru_prev = &itable.lru;
+            itable.lru.lru_next->lru_prev = ip;
+            itable.lru.lru_next = ip;
+        } else {
+            itable_hash_remove(ip);
+            ip->hnext = itable.free;
+            itable.free = ip;
+        }
+    }
 }
 
 // 从 inode 读取数据到 dst
@@ -398,21 +956,32 @@ int fs_inode_read_data(struct inode *ip, int is_user_addr, char *dst, uint off,
     if (off + n > ip->size)
         n = ip->size - off;
 
+    // 内联的内容就在 inode 里，不用读盘
+    if (ip->flags & I_INLINE) {
+        char *data = (char *) ip->addrs + off;
+        if (is_user_addr)
+            vmem_copyout(proc_running()->pagetable, (uint64) dst, data, n);
+        else
+            memmove(dst, data, n);
+        return n;
+    }
+
+    // 普通文件的数据走页缓存
+    if (ip->type == T_FILE)
+        return pcache_read(ip, is_user_addr, dst, off, n);
+
     // 2. 循环读取，以块为单位读取
     for (tot = 0; tot < n; tot += m, off += m, dst += m) {
-        // bmap 找到物理块号
-        uint addr = fs_inode_map(ip, off / BSIZE);
+        // bmap 找到物理块号，读路径不分配：空洞返回 0，不碰 bitmap 也不写 inode
+        uint addr = fs_inode_bmap(ip, off / BSIZE);
         // 计算本次能读多少：
         // 也就是：min(剩余总长度, 当前块剩余空间)
         m = min(n - tot, BSIZE - off % BSIZE);
         if (addr == 0) {
             // 稀疏区域：填充零
             if (is_user_addr) {
-                // 用户空间：需要逐个字节或使用辅助函数清零
-                char zero = 0;
-                for (uint i = 0; i < m; i++) {
-                    vmem_copyout(proc_running()->pagetable, (uint64) (dst + i), &zero, 1);
-                }
+                // 用户空间：按页整段清零
+                vmem_zeroout(proc_running()->pagetable, (uint64) dst, m);
             } else {
                 // 内核空间：直接 memset
                 memset(dst, 0, m);
@@ -445,36 +1014,96 @@ int fs_inode_write_data(struct inode *ip, int is_user_addr, char *src, uint off,
     struct fsbuf *bp;
 
     // 1. 边界检查 (限制最大文件大小)
-    if (off + n < off || (uint64) off + n > MAXFILE * BSIZE)
+    if (off + n < off || (uint64) off + n > MAXFILE_BYTES)
         return -1;
 
-    // 2. 循环写入
-    for (tot = 0; tot < n; tot += m, off += m, src += m) {
-        // map 会自动分配不存在的块
-        uint addr = fs_inode_map(ip, off / BSIZE);
-        if (addr == 0)
-            break; // 磁盘满或者是分配失败
+    // 内联的 inode：放得下就直接写进 inode（随 inode 块进日志），放不下先转成块映射
+    if (ip->flags & I_INLINE) {
+        if (off + n <= FS_INLINE_MAX) {
+            char *data = (char *) ip->addrs;
+            if (off > ip->size)
+                memset(data + ip->size, 0, off - ip->size); // 跳过的部分是空洞，读出来是 0
+            if (is_user_addr) {
+                if (vmem_copyin(proc_running()->pagetable, data + off, (uint64) src, n) < 0)
+                    return -1;
+            } else {
+                memmove(data + off, src, n);
+            }
+            if (off + n > ip->size)
+                ip->size = off + n;
+            fs_inode_write(ip);
+            return n;
+        }
+        fs_inline_to_blocks(ip);
+    }
 
-        bp = fsbuf_read(ip->dev, addr);
+    // 普通文件的数据写进页缓存
+    if (ip->type == T_FILE) {
+        tot = pcache_write(ip, is_user_addr, src, off, n);
+        off += tot;
+        goto out;
+    }
 
-        // 计算本次写入长度
-        m = BSIZE - (off % BSIZE);
-        if (n - tot < m)
-            m = n - tot;
+    // 2. 循环写入（目录）
+    //    碰到没分配的块，先把这次写要用到的、连续缺着的块一次分配成物理连续的一段；
+    //    新块的旧内容没用，不读盘、不单独清零，只在 buffer 里把不会被覆盖的部分填 0
+    for (tot = 0; tot < n;) {
+        uint bn = off / BSIZE;
+        uint addr = fs_inode_bmap(ip, bn);
+        uint run = 1;
+        int fresh = addr == 0;
+        if (fresh) {
+            uint last = (off + (n - tot) - 1) / BSIZE;
+            uint want = 1;
+            while (bn + want <= last && want < FS_ALLOC_RUN && fs_inode_bmap(ip, bn + want) == 0)
+                want++;
+            addr = fs_block_alloc_run(ip->dev, want, &run);
+            for (uint k = 0; k < run; k++)
+                fs_inode_assign(ip, bn + k, addr + k);
+        }
 
-        // 拷贝数据
-        if (is_user_addr)
-            vmem_copyin(proc_running()->pagetable, (void *) bp->data + (off % BSIZE), (uint64) src, m);
-        else
-            memmove(bp->data + (off % BSIZE), src, m);
+        for (uint k = 0; k < run && tot < n; k++, tot += m, off += m, src += m) {
+            // 计算本次写入长度
+            m = BSIZE - (off % BSIZE);
+            if (n - tot < m)
+                m = n - tot;
 
-        // 标记脏并写回
-        fslog_write(bp);
-        fsbuf_release(bp);
+            if (fresh) {
+                bp = fsbuf_overwrite(ip->dev, addr + k);
+                if (m < BSIZE)
+                    memset(bp->data, 0, BSIZE);
+            } else {
+                bp = fsbuf_read(ip->dev, addr + k);
+            }
+
+            // 拷贝数据
+            int bad = 0;
+            if (is_user_addr)
+                bad = vmem_copyin(proc_running()->pagetable, (void *) bp->data + (off % BSIZE), (uint64) src, m) < 0;
+            else
+                memmove(bp->data + (off % BSIZE), src, m);
+            if (bad && fresh)
+                memset(bp->data, 0, BSIZE); // 新块不能留着别的文件的旧数据
+
+            // 目录块是元数据，进日志
+            fslog_write(bp);
+            fsbuf_release(bp);
+            if (bad) {
+                // 这一段后面还没写到的新块已经挂在 inode 上了，也要清零，不能留着旧数据
+                for (k++; fresh && k < run; k++) {
+                    bp = fsbuf_overwrite(ip->dev, addr + k);
+                    memset(bp->data, 0, BSIZE);
+                    fslog_write(bp);
+                    fsbuf_release(bp);
+                }
+                goto out;
+            }
+        }
     }
 
+out:
     // 3. 如果写入导致文件变大，更新 size
-    if (n > 0 && off > ip->size) {
+    if (tot > 0 && off > ip->size) {
         ip->size = off;
         fs_inode_write(ip); // 更新 inode 元数据
     }
@@ -484,43 +1113,427 @@ int fs_inode_write_data(struct inode *ip, int is_user_addr, char *src, uint off,
 
 // ================ 目录相关 ================
 
+// 比较目录项名字，最多 DIRSIZ 个字节，不一定以 0 结尾
+int fs_namecmp(const char *a, const char *b) {
+    for (int i = 0; i < DIRSIZ; i++) {
+        if (a[i] != b[i])
+            return 1;
+        if (a[i] == 0)
+            return 0;
+    }
+    return 0;
+}
+
+// 读出目录偏移 off 所在的块，*n 返回这块里有效的目录项个数
+// 目录按块扫描：一块只做一次映射和一次 fsbuf_read，然后原地遍历里面的目录项
+static struct fsbuf *fs_dir_block(struct inode *dp, uint off, uint *n) {
+    uint addr = fs_inode_bmap(dp, off / BSIZE);
+    if (addr == 0)
+        panic("fs_dir_block: hole in directory");
+    uint boff = off - off % BSIZE;
+    *n = min(BSIZE, dp->size - boff) / sizeof(struct dirent);
+    return fsbuf_read(dp->dev, addr);
+}
+
+// ---------------- 哈希索引目录 ----------------
+
+// 查找时从根走到叶子记下的路径，拆分叶子后往上插索引项要用
+struct dx_path {
+    int levels;
+    uint node_bn; // 中间节点的逻辑块号（levels == 2 时有效）
+    uint leaf_bn; // 叶子的逻辑块号
+};
+
+// 读目录的第 bn 个逻辑块
+static struct fsbuf *dx_read(struct inode *dp, uint bn) {
+    uint n;
+    return fs_dir_block(dp, bn * BSIZE, &n);
+}
+
+static struct dx_root *dx_root_of(struct fsbuf *bp) {
+    return (struct dx_root *) (bp->data + DX_ROOT_SLOT * sizeof(struct dirent));
+}
+
+static struct dx_entry *dx_root_entries(struct dx_root *root) {
+    return (struct dx_entry *) (root + 1);
+}
+
+static struct dx_entry *dx_node_entries(struct dx_node *node) {
+    return (struct dx_entry *) (node + 1);
+}
+
+// 目录是不是索引格式：至少两块，第 0 块的 DX_ROOT_SLOT 槽位是 dx_root
+// 线性目录里空槽位整个是 0，不会被误认成 dx_root
+static int dx_is_indexed(struct inode *dp) {
+    if (dp->size < 2 * BSIZE)
+        return 0;
+    struct fsbuf *bp = dx_read(dp, 0);
+    struct dx_root *root = dx_root_of(bp);
+    int r = root->zero == 0 && root->magic == DX_ROOT_MAGIC;
+    fsbuf_release(bp);
+    return r;
+}
+
+// 二分：最后一个 hash <= h 的索引项，第 0 项总是算命中
+static int dx_search(struct dx_entry *e, int count, uint h) {
+    int lo = 1, hi = count;
+    while (lo < hi) {
+        int mid = (lo + hi) / 2;
+        if (e[mid].hash <= h)
+            lo = mid + 1;
+        else
+            hi = mid;
+    }
+    return lo - 1;
+}
+
+// 从根往下找哈希 h 所在的叶子，返回叶子的逻辑块号
+static uint dx_find_leaf(struct inode *dp, uint h, struct dx_path *path) {
+    struct fsbuf *bp = dx_read(dp, 0);
+    struct dx_root *root = dx_root_of(bp);
+    if (root->levels < 1 || root->levels > DX_MAXLEVELS || root->count == 0)
+        panic("dx_find_leaf: bad root");
+    struct dx_entry *e = dx_root_entries(root);
+    uint bn = e[dx_search(e, root->count, h)].block;
+    path->levels = root->levels;
+    fsbuf_release(bp);
+
+    if (path->levels == 2) {
+        path->node_bn = bn;
+        bp = dx_read(dp, bn);
+        struct dx_node *node = (struct dx_node *) bp->data;
+        if (node->magic != DX_NODE_MAGIC || node->count == 0)
+            panic("dx_find_leaf: bad node");
+        e = dx_node_entries(node);
+        bn = e[dx_search(e, node->count, h)].block;
+        fsbuf_release(bp);
+    }
+    path->leaf_bn = bn;
+    return bn;
+}
+
+// 目录末尾加一个清零的块，返回它的逻辑块号
+static uint dx_grow(struct inode *dp) {
+    uint bn = dp->size / BSIZE;
+    fs_inode_map(dp, bn);
+    dp->size += BSIZE;
+    fs_inode_write(dp);
+    return bn;
+}
+
+// 目录项挪了位置：缓存里有这一项的话把偏移改过来
+static void dx_moved(struct inode *dp, char *name, uint off) {
+    uint inum;
+    if (dcache_lookup(dp->dev, dp->inum, name, &inum, 0))
+        dcache_enter(dp->dev, dp->inum, name, inum, off);
+}
+
+// 有序插入一个索引项，调用者保证还有位置
+static void dx_insert_at(struct dx_entry *e, ushort *count, uint hash, uint bn) {
+    int i = dx_search(e, *count, hash) + 1;
+    memmove(&e[i + 1], &e[i], (*count - i) * sizeof(struct dx_entry));
+    memset(&e[i], 0, sizeof(struct dx_entry));
+    e[i].hash = hash;
+    e[i].block = bn;
+    (*count)++;
+}
+
+// 把指向新叶子的索引项 (hash, bn) 插进 path 上的最后一层索引
+// 根满了就把根的索引项整体搬到新的中间节点，树长高一层；中间节点满了就对半拆开
+// 调用者已经确认过空间够用
+static void dx_insert(struct inode *dp, struct dx_path *path, uint hash, uint bn) {
+    struct fsbuf *rbp, *nbp, *sbp;
+    struct dx_root *root;
+    struct dx_node *node, *sib;
+
+    if (path->levels == 1) {
+        rbp = dx_read(dp, 0);
+        root = dx_root_of(rbp);
+        if (root->count < DX_ROOT_LIMIT) {
+            dx_insert_at(dx_root_entries(root), &root->count, hash, bn);
+            fslog_write(rbp);
+            fsbuf_release(rbp);
+            return;
+        }
+        fsbuf_release(rbp);
+
+        uint nbn = dx_grow(dp);
+        rbp = dx_read(dp, 0);
+        nbp = dx_read(dp, nbn);
+        root = dx_root_of(rbp);
+        node = (struct dx_node *) nbp->data;
+        node->magic = DX_NODE_MAGIC;
+        node->count = root->count;
+        memmove(dx_node_entries(node), dx_root_entries(root), root->count * sizeof(struct dx_entry));
+        memset(dx_root_entries(root), 0, root->count * sizeof(struct dx_entry));
+        root->levels = 2;
+        root->count = 1;
+        dx_root_entries(root)[0].block = nbn;
+        fslog_write(nbp);
+        fslog_write(rbp);
+        fsbuf_release(nbp);
+        fsbuf_release(rbp);
+        path->levels = 2;
+        path->node_bn = nbn;
+    }
+
+    nbp = dx_read(dp, path->node_bn);
+    node = (struct dx_node *) nbp->data;
+    if (node->count < DX_NODE_LIMIT) {
+        dx_insert_at(dx_node_entries(node), &node->count, hash, bn);
+        fslog_write(nbp);
+        fsbuf_release(nbp);
+        return;
+    }
+    fsbuf_release(nbp);
+
+    // 后一半搬到新节点，新节点的起始哈希插到根里
+    uint sbn = dx_grow(dp);
+    rbp = dx_read(dp, 0);
+    nbp = dx_read(dp, path->node_bn);
+    sbp = dx_read(dp, sbn);
+    root = dx_root_of(rbp);
+    node = (struct dx_node *) nbp->data;
+    sib = (struct dx_node *) sbp->data;
+    struct dx_entry *ne = dx_node_entries(node), *se = dx_node_entries(sib);
+    int half = node->count / 2;
+    uint shash = ne[half].hash;
+    sib->magic = DX_NODE_MAGIC;
+    sib->count = node->count - half;
+    memmove(se, &ne[half], sib->count * sizeof(struct dx_entry));
+    memset(&ne[half], 0, sib->count * sizeof(struct dx_entry));
+    node->count = half;
+    dx_insert_at(dx_root_entries(root), &root->count, shash, sbn);
+    if (hash >= shash)
+        dx_insert_at(se, &sib->count, hash, bn);
+    else
+        dx_insert_at(ne, &node->count, hash, bn);
+    fslog_write(sbp);
+    fslog_write(nbp);
+    fslog_write(rbp);
+    fsbuf_release(sbp);
+    fsbuf_release(nbp);
+    fsbuf_release(rbp);
+}
+
+// 叶子满了：按哈希中位数拆成两块，哈希 >= 分界的目录项搬到新叶子
+// 相同哈希的项不会被拆开，所以查找只需要看一个叶子
+// 索引或文件大小已经到上限时返回 -1
+static int dx_split(struct inode *dp, struct dx_path *path) {
+    // 4K 块有 256 项，放内核栈上太大；目录操作都在日志锁下串行，用静态的就行
+    static uint hs[BSIZE / sizeof(struct dirent)];
+    int n = BSIZE / sizeof(struct dirent);
+
+    // 先确认空间：最多要一个新叶子和一个新中间节点
+    if (dp->size / BSIZE + 2 > MAXFILE)
+        return -1;
+    if (path->levels == 2) {
+        struct fsbuf *bp = dx_read(dp, path->node_bn);
+        int full = ((struct dx_node *) bp->data)->count >= DX_NODE_LIMIT;
+        fsbuf_release(bp);
+        if (full) {
+            bp = dx_read(dp, 0);
+            full = dx_root_of(bp)->count >= DX_ROOT_LIMIT;
+            fsbuf_release(bp);
+            if (full)
+                return -1;
+        }
+    }
+
+    // 排序后取中位数，遇到相同哈希往后（不行再往前）挪分界
+    struct fsbuf *bp = dx_read(dp, path->leaf_bn);
+    struct dirent *de = (struct dirent *) bp->data;
+    for (int i = 0; i < n; i++) {
+        uint h = dx_hash(de[i].name);
+        int j = i;
+        for (; j > 0 && hs[j - 1] > h; j--)
+            hs[j] = hs[j - 1];
+        hs[j] = h;
+    }
+    fsbuf_release(bp);
+    int m = n / 2;
+    while (m < n && hs[m] == hs[m - 1])
+        m++;
+    if (m == n) {
+        m = n / 2;
+        while (m > 0 && hs[m] == hs[m - 1])
+            m--;
+        if (m == 0)
+            return -1; // 整块都是同一个哈希
+    }
+    uint split = hs[m];
+
+    uint nbn = dx_grow(dp);
+    struct fsbuf *obp = dx_read(dp, path->leaf_bn);
+    struct fsbuf *nbp = dx_read(dp, nbn);
+    struct dirent *od = (struct dirent *) obp->data, *nd = (struct dirent *) nbp->data;
+    int k = 0;
+    for (int i = 0; i < n; i++) {
+        if (od[i].inum == 0 || dx_hash(od[i].name) < split)
+            continue;
+        nd[k] = od[i];
+        memset(&od[i], 0, sizeof(struct dirent));
+        dx_moved(dp, nd[k].name, nbn * BSIZE + k * sizeof(struct dirent));
+        k++;
+    }
+    fslog_write(nbp);
+    fslog_write(obp);
+    fsbuf_release(nbp);
+    fsbuf_release(obp);
+
+    dx_insert(dp, path, split, nbn);
+    return 0;
+}
+
+// 线性目录第一块满了，转成索引格式：
+// 除 "." 和 ".." 以外的目录项搬到新的第 1 块当唯一的叶子，第 0 块放 dx_root
+static void dx_convert(struct inode *dp) {
+    uint lbn = dx_grow(dp);
+    struct fsbuf *rbp = dx_read(dp, 0);
+    struct fsbuf *lbp = dx_read(dp, lbn);
+    struct dirent *de = (struct dirent *) rbp->data, *le = (struct dirent *) lbp->data;
+    int k = 0;
+    for (int i = DX_ROOT_SLOT; i < BSIZE / sizeof(struct dirent); i++) {
+        if (de[i].inum == 0)
+            continue;
+        le[k] = de[i];
+        dx_moved(dp, le[k].name, lbn * BSIZE + k * sizeof(struct dirent));
+        k++;
+    }
+    memset(&de[DX_ROOT_SLOT], 0, BSIZE - DX_ROOT_SLOT * sizeof(struct dirent));
+    struct dx_root *root = dx_root_of(rbp);
+    root->magic = DX_ROOT_MAGIC;
+    root->levels = 1;
+    root->count = 1;
+    dx_root_entries(root)[0].block = lbn;
+    fslog_write(lbp);
+    fslog_write(rbp);
+    fsbuf_release(lbp);
+    fsbuf_release(rbp);
+}
+
+// 往索引目录里加一个目录项，*poff 返回它的偏移；目录满了返回 -1
+static int dx_add(struct inode *dp, struct dirent *ent, uint *poff) {
+    struct dx_path path;
+    uint h = dx_hash(ent->name);
+    for (;;) {
+        uint leaf = dx_find_leaf(dp, h, &path);
+        struct fsbuf *bp = dx_read(dp, leaf);
+        struct dirent *de = (struct dirent *) bp->data;
+        for (int i = 0; i < BSIZE / sizeof(struct dirent); i++) {
+            if (de[i].inum != 0)
+                continue;
+            de[i] = *ent;
+            fslog_write(bp);
+            fsbuf_release(bp);
+            *poff = leaf * BSIZE + i * sizeof(struct dirent);
+            return 0;
+        }
+        fsbuf_release(bp);
+        if (dx_split(dp, &path) < 0)
+            return -1;
+    }
+}
+
+// 取目录偏移 off 所在的那一段目录项，*n 返回这段里有效的目录项个数
+// 块目录是 off 所在的那一整块，*bpp 返回要还回去的 buffer；内联目录就是 inode 里那几项，*bpp 为 0
+static struct dirent *fs_dir_chunk(struct inode *dp, uint off, uint *n, struct fsbuf **bpp) {
+    if (dp->flags & I_INLINE) {
+        *bpp = 0;
+        *n = dp->size / sizeof(struct dirent);
+        return (struct dirent *) dp->addrs;
+    }
+    *bpp = fs_dir_block(dp, off, n);
+    return (struct dirent *) (*bpp)->data;
+}
+
+static void fs_dir_chunk_put(struct fsbuf *bp) {
+    if (bp)
+        fsbuf_release(bp);
+}
+
+// 在目录偏移 [start, end) 里按块找名字，找到返回 1，*inum、*off 是结果
+static int fs_dir_scan(struct inode *dp, char *name, uint start, uint end, uint *inum, uint *off) {
+    uint n;
+    for (uint boff = start - start % BSIZE; boff < end; boff += BSIZE) {
+        struct fsbuf *bp;
+        struct dirent *de = fs_dir_chunk(dp, boff, &n, &bp);
+        uint last = min(n, (end - boff) / sizeof(struct dirent));
+        for (uint i = boff < start ? (start - boff) / sizeof(struct dirent) : 0; i < last; i++) {
+            // 如果 inum 为 0，说明这个槽位是空的，跳过
+            if (de[i].inum == 0)
+                continue;
+            if (fs_namecmp(name, de[i].name) == 0) {
+                *inum = de[i].inum;
+                *off = boff + i * sizeof(struct dirent);
+                fs_dir_chunk_put(bp);
+                return 1;
+            }
+        }
+        fs_dir_chunk_put(bp);
+    }
+    return 0;
+}
+
 // 在目录 dp 中查找名为 name 的文件
 // 如果找到了，返回对应的 inode (已经 iget，引用计数+1)
 // poff: 可选参数，如果不为0，则记录找到的目录项在目录文件内的偏移量
 struct inode *fs_dir_lookup(struct inode *dp, char *name, uint *poff) {
     uint off, inum;
-    struct dirent de;
 
     if (dp->type != T_DIR)
         panic("fs_dir_lookup: not a directory");
 
-    // 遍历目录文件的内容
-    // 每次读一个 dirent 大小
-    for (off = 0; off < dp->size; off += sizeof(de)) {
-        // 获取目录项内容
-        if (fs_inode_read_data(dp, 0, (char *) &de, off, sizeof(de)) != sizeof(de))
-            panic("fs_dir_lookup: read");
-        // 如果 inum 为 0，说明这个槽位是空的，跳过
-        if (de.inum == 0)
-            continue;
+    // 先查目录项缓存，命中的话不用读目录
+    if (dcache_lookup(dp->dev, dp->inum, name, &inum, poff)) {
+        if (inum == 0)
+            return 0; // 负缓存：确定没有
+        return fs_inode_get(dp->dev, inum);
+    }
 
-        // 比较名字
-        if (strcmp(name, de.name) == 0) {
-            // 找到了
-            if (poff)
-                *poff = off;
-            inum = de.inum;
-            // 通过 inode 号获取内存 inode
-            return fs_inode_get(dp->dev, inum);
-        }
+    // 索引目录只看 "." ".." 和哈希对应的那个叶子，线性目录从头扫到尾
+    int found;
+    if (dx_is_indexed(dp)) {
+        struct dx_path path;
+        uint leaf = dx_find_leaf(dp, dx_hash(name), &path);
+        found = fs_dir_scan(dp, name, 0, DX_ROOT_SLOT * sizeof(struct dirent), &inum, &off) ||
+                fs_dir_scan(dp, name, leaf * BSIZE, (leaf + 1) * BSIZE, &inum, &off);
+    } else {
+        found = fs_dir_scan(dp, name, 0, dp->size, &inum, &off);
+    }
+    if (found) {
+        if (poff)
+            *poff = off;
+        dcache_enter(dp->dev, dp->inum, name, inum, off);
+        // 通过 inode 号获取内存 inode
+        return fs_inode_get(dp->dev, inum);
     }
 
+    dcache_enter(dp->dev, dp->inum, name, 0, 0); // 记一条负缓存
     return 0; // 没找到
 }
 
+// 从 start 开始找第一个空槽位 (inum == 0)，没有就返回 dp->size（追加）
+static uint fs_dir_find_free(struct inode *dp, uint start) {
+    uint n;
+    for (uint off = start - start % BSIZE; off < dp->size; off += BSIZE) {
+        struct fsbuf *bp;
+        struct dirent *de = fs_dir_chunk(dp, off, &n, &bp);
+        for (uint i = 0; i < n; i++) {
+            uint o = off + i * sizeof(struct dirent);
+            if (o >= start && de[i].inum == 0) {
+                fs_dir_chunk_put(bp);
+                return o;
+            }
+        }
+        fs_dir_chunk_put(bp);
+    }
+    return dp->size;
+}
+
 // 在目录 dp 中添加一个新的目录项 (name, inum)
 int fs_dir_link(struct inode *dp, char *name, uint inum) {
-    int off;
+    uint off;
     struct dirent de;
     struct inode *ip;
 
@@ -535,26 +1548,65 @@ int fs_dir_link(struct inode *dp, char *name, uint inum) {
         return -1;
     }
 
-    // 2. 找一个空槽位 (inum == 0 的位置)
-    for (off = 0; off < dp->size; off += sizeof(de)) {
-        if (fs_inode_read_data(dp, 0, (char *) &de, off, sizeof(de)) != sizeof(de))
-            panic("fs_dir_link: read");
-        if (de.inum == 0)
-            break; // 找到了空位，就在这写
-    }
-
-    // 3. 准备目录项数据
+    // 2. 准备目录项数据
     memset(&de, 0, sizeof(de)); // 🔥 先清零整个结构体！
     strncpy(de.name, name, DIRSIZ); // 使用 strncpy 更安全
     de.inum = inum;
 
+    // 3. 线性目录找一个空槽位 (inum == 0 的位置)，dir_free 之前的都被占着，不用再看
+    //    只有一块的目录放满了就转成索引目录，更早的多块线性目录保持原样
+    int indexed = dx_is_indexed(dp);
+    if (!indexed) {
+        off = fs_dir_find_free(dp, dp->dir_free);
+        if (off >= BSIZE && dp->size == BSIZE) {
+            dx_convert(dp);
+            indexed = 1;
+        }
+    }
+
     // 4. 写入目录文件 (如果是追加，write_data 会自动扩容)
-    if (fs_inode_write_data(dp, 0, (char *) &de, off, sizeof(de)) != sizeof(de))
-        panic("fs_dir_link: write");
+    if (indexed) {
+        if (dx_add(dp, &de, &off) < 0)
+            return -1;
+    } else {
+        if (fs_inode_write_data(dp, 0, (char *) &de, off, sizeof(de)) != sizeof(de))
+            panic("fs_dir_link: write");
+        dp->dir_free = off + sizeof(de);
+    }
+    // 覆盖掉可能存在的负缓存
+    dcache_enter(dp->dev, dp->inum, name, inum, off);
 
     return 0;
 }
 
+// 清掉目录 dp 里偏移 off 处的目录项
+void fs_dir_unlink(struct inode *dp, char *name, uint off) {
+    struct dirent de;
+    memset(&de, 0, sizeof(de));
+    if (fs_inode_write_data(dp, 0, (char *) &de, off, sizeof(de)) != sizeof(de))
+        panic("fs_dir_unlink: write");
+    if (off < dp->dir_free)
+        dp->dir_free = off;
+    dcache_enter(dp->dev, dp->inum, name, 0, 0); // 名字没了，记成负缓存
+}
+
+// 目录里除了 "." 和 ".." 还有没有别的项
+int fs_dir_is_empty(struct inode *dp) {
+    uint n;
+    for (uint off = 0; off < dp->size; off += BSIZE) {
+        struct fsbuf *bp;
+        struct dirent *de = fs_dir_chunk(dp, off, &n, &bp);
+        for (uint i = (off == 0 ? 2 : 0); i < n; i++) {
+            if (de[i].inum != 0) {
+                fs_dir_chunk_put(bp);
+                return 0;
+            }
+        }
+        fs_dir_chunk_put(bp);
+    }
+    return 1;
+}
+
 // 解析路径，提取下一个文件名
 // Examples:
 //   skipelem("a/bb/c", name) = "bb/c", setting name = "a"
@@ -658,49 +1710,38 @@ struct inode *fs_nameiparent(char *path, char *name) {
 // ================ 信息显示 =================
 // 统计空闲数据块数量
 uint64 fs_count_free_blocks(int dev) {
-    uint64 free_count = 0;
-    struct fsbuf *bp;
-    int bi, m;
-
-    // 遍历所有 bitmap 块
-    for (uint b = 0; b < sb.size; b += BPB) {
-        bp = fsbuf_read(dev, BBLOCK(b, sb));
-        for (bi = 0; bi < BPB && b + bi < sb.size; bi++) {
-            m = 1 << (bi % 8);
-            if (((bp->data[bi / 8] & m) == 0)) {
-                // 0 表示空闲
-                free_count++;
-            }
-        }
-        fsbuf_release(bp);
-    }
-    return free_count;
+    // 分配器里按 bitmap 块记着空闲数，加起来就行
+    return fs_alloc_nfree(dev, &balloc);
 }
 
 // 统计空闲 Inode 数量
 uint64 fs_count_free_inodes(int dev) {
-    uint64 free_count = 0;
-    struct fsbuf *bp;
-    struct dinode *dip;
+    // 和数据块一样数 inode bitmap，不用扫 inode 表
+    return fs_alloc_nfree(dev, &ialloc);
+}
 
-    for (int inum = 1; inum < sb.ninodes; inum++) {
-        bp = fsbuf_read(dev, IBLOCK(inum, sb));
-        dip = (struct dinode *) bp->data + (inum % IPB);
-        if (dip->type == 0) {
-            free_count++;
-        }
-        fsbuf_release(bp);
-    }
-    return free_count;
+// 挂载时确定空闲计数：正常关机时超级块里的就是准的；
+// 重放过日志或者镜像没带计数，就扫一遍两个 bitmap 重建
+static void fs_counts_init(uint dev, int replayed) {
+    if (!replayed && (sb.flags & FS_FLAG_COUNTS))
+        return;
+    sb.nfree_blocks = fs_count_free_blocks(dev);
+    sb.nfree_inodes = fs_count_free_inodes(dev);
+    sb.flags |= FS_FLAG_COUNTS;
+    // 挂载阶段没有别的事务，直接写
+    struct fsbuf *bp = fsbuf_read(dev, 1);
+    memmove(bp->data, &sb, sizeof(sb));
+    fsbuf_write(bp);
+    fsbuf_release(bp);
 }
 
 // 获取文件系统信息接口 (供系统调用使用)
 // 我们可以定义一个 struct fs_info
 void fs_get_info(int dev, uint64 *total_blocks, uint64 *free_blocks, uint64 *total_inodes, uint64 *free_inodes) {
     *total_blocks = sb.nblocks; // 或者 sb.size，看你想显示哪个
-    *free_blocks = fs_count_free_blocks(dev);
+    *free_blocks = sb.nfree_blocks; // 增量维护，不用再扫 bitmap
     *total_inodes = sb.ninodes;
-    *free_inodes = fs_count_free_inodes(dev);
+    *free_inodes = sb.nfree_inodes;
 }
 
 
@@ -1089,10 +2130,10 @@ void fs_test_stress(int dev) {
     huge->nlink++;
     fs_inode_write(huge);
 
-    // 写入 14KB 数据 (直接块只有 12KB，这里必然触发间接块)
+    // 写入比直接块多 4 块的数据，这里必然触发间接块
     // 我们写入一个特殊的 pattern，比如每个字节都是对应偏移量的低8位
-    char buf[BSIZE];
-    int total_size = 14 * 1024;
+    static char buf[BSIZE];
+    int total_size = (NDIRECT + 4) * BSIZE;
 
     printf("   Writing %d bytes...\n", total_size);
     for (int i = 0; i < total_size; i += BSIZE) {
@@ -1131,18 +2172,18 @@ void fs_test_stress(int dev) {
     dir->nlink++; // 根目录指向它
     fs_inode_write(dir);
 
-    // 一个块 1024 字节，dirent 16 字节，一个块能存 64 个。
-    // 我们创建 70 个文件，强制它分配第二个块。
-    int file_count = 70;
+    // 一个块能存 BSIZE / sizeof(struct dirent) 个目录项，多建 6 个强制它分配第二个块。
+    // 块大的时候目录项比 inode 还多，所以都链接到同一个文件上
+    int file_count = BSIZE / sizeof(struct dirent) + 6;
     printf("   Creating %d files in /many_files/ ...\n", file_count);
 
+    struct inode *f = fs_inode_alloc(dev, T_FILE);
     for (int i = 0; i < file_count; i++) {
-        struct inode *f = fs_inode_alloc(dev, T_FILE);
         char name[DIRSIZ];
         char num[8];
         itoa_simple(i, num);
 
-        // 名字是 f0, f1, ... f69
+        // 名字是 f0, f1, ...
         memset(name, 0, DIRSIZ);
         name[0] = 'f';
         strcpy(name + 1, num);
@@ -1150,12 +2191,13 @@ void fs_test_stress(int dev) {
         if (fs_dir_link(dir, name, f->inum) < 0) panic("link failed in loop");
 
         f->nlink++;
-        fs_inode_write(f);
-        fs_inode_release(f);
     }
+    fs_inode_write(f);
+    int last_inum = f->inum;
+    fs_inode_release(f);
 
-    printf("   Directory size is now: %d bytes (Expected > 1024)\n", dir->size);
-    if (dir->size <= 1024) panic("Directory did not expand to 2nd block!");
+    printf("   Directory size is now: %d bytes (Expected > %d)\n", dir->size, BSIZE);
+    if (dir->size <= BSIZE) panic("Directory did not expand to 2nd block!");
 
     fs_inode_release(dir); // 释放目录
 
@@ -1172,11 +2214,14 @@ void fs_test_stress(int dev) {
     printf("   Found /huge_file (size %d) ✅ \n", target_huge->size);
     fs_inode_release(target_huge);
 
-    // 2. 找回第 68 号小文件
-    struct inode *target_small = fs_namei("/many_files/f68");
-    if (target_small == 0) panic("Lost /many_files/f68");
+    // 2. 找回最后一个小文件，它在目录的第二个块里
+    char path[32] = "/many_files/f";
+    itoa_simple(file_count - 1, path + strlen(path));
+    struct inode *target_small = fs_namei(path);
+    if (target_small == 0) panic("Lost last file in /many_files");
     fs_inode_read(target_small); // 🔥 记得读盘！
-    printf("   Found /many_files/f68 (inum %d) ✅ \n", target_small->inum);
+    if (target_small->inum != last_inum) panic("Last file in /many_files has the wrong inode");
+    printf("   Found %s (inum %d) ✅ \n", path, target_small->inum);
     fs_inode_release(target_small);
 
     fs_inode_release(root);
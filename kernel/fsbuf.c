@@ -1,6 +1,7 @@
 #include "../include/fs.h"
 #include "../include/param.h"
 #include "../include/printf.h"
+#include "../include/sysinfo.h"
 
 // dev 在简化版本里面暂时用不上
 
@@ -8,6 +9,7 @@ struct {
     // buf缓存块
     // 以后访问时会不断把“刚用过的 buf”移到 head.next，形成真正的 LRU。
     struct fsbuf buf[FSBUF_NUM];
+    uchar data[FSBUF_NUM][BSIZE];
     // head 是哑元节点，不存真正数据，只是为了做好一个“永远不空”的链表。
     struct fsbuf head;
 } fsbuf_cache;
@@ -23,6 +25,7 @@ void fsbuf_init(void) {
         b->refcnt = 0;
         b->blockno = 0;
         b->dev = 0;
+        b->data = fsbuf_cache.data[b - fsbuf_cache.buf];
         sleeplock_init(&b->lock, "fsbuf");
         b->next = fsbuf_cache.head.next;
         b->prev = &fsbuf_cache.head;
@@ -71,30 +74,34 @@ struct fsbuf *fsbuf_read(uint dev, uint blockno) {
     sleeplock_acquire(&b->lock);
     if (!b->valid) {
         // 还没读过，去驱动读=
-        virtio_disk_rw(b, 0);
+        iosched_rw(b, 0);
         b->valid = 1;
     }
     return b;
 }
 
+// 拿一个块的缓存并加锁，但不从磁盘读：调用者马上要整块覆盖它（比如刚分配的块）
+struct fsbuf *fsbuf_overwrite(uint dev, uint blockno) {
+    struct fsbuf *b = fsbuf_get(dev, blockno);
+    sleeplock_acquire(&b->lock);
+    b->valid = 1;
+    return b;
+}
+
 // 写回一个块（缓存到磁盘）
 void fsbuf_write(struct fsbuf *b) {
-    virtio_disk_rw(b, 1);
+    iosched_rw(b, 1);
 }
 
-// 用完这个 fsbuf，降低引用计数，让它可以被 LRU 回收
-void fsbuf_release(struct fsbuf *b) {
-    sleeplock_release(&b->lock);
-    b->refcnt--;
-    if (b->refcnt < 0) {
-        panic("fsbuf_release: refcnt <= 0");
+// 引用计数减一，没人用了就移到链表头部 (head.next)
+// 表示它是“最近刚用过” (Most Recently Used)，这样 LRU 算法就会最后才回收它
+static void fsbuf_put(struct fsbuf *b) {
+    if (b->refcnt == 0) {
+        panic("fsbuf_put: refcnt == 0");
     }
+    b->refcnt--;
 
     if (b->refcnt == 0) {
-        // 如果没人用了，把它移到链表头部 (head.next)
-        // 表示它是“最近刚用过” (Most Recently Used)
-        // 这样 LRU 算法就会最后才回收它
-
         // 1. 把 b 从当前位置摘出来
         b->next->prev = b->prev;
         b->prev->next = b->next;
@@ -107,6 +114,98 @@ void fsbuf_release(struct fsbuf *b) {
     }
 }
 
+// 用完这个 fsbuf，降低引用计数，让它可以被 LRU 回收
+void fsbuf_release(struct fsbuf *b) {
+    sleeplock_release(&b->lock);
+    fsbuf_put(b);
+}
+
+// 把 buffer 钉在缓存里，不让 LRU 回收（日志层用，不需要持有锁）
+void fsbuf_pin(struct fsbuf *b) {
+    b->refcnt++;
+}
+
+// 取消 fsbuf_pin
+void fsbuf_unpin(struct fsbuf *b) {
+    fsbuf_put(b);
+}
+
+// ================== 多块 I/O =================
+
+// 把块号连续的一组 buffer 作为分散/聚集请求写盘：bufs[i] 写到 blockno + i
+// 写的可以是别的块的内容（比如日志把原位块的数据直接写进日志区），
+// 调用者保证这些 buffer 在写完之前不会被回收
+void fsbuf_write_vec(uint blockno, struct fsbuf **bufs, int n) {
+    virtio_disk_submit_vec(blockno, bufs, n, 1);
+    // 批量写一次要传很多块，不值得轮询，睡眠等中断把 CPU 让给别人
+    for (int i = 0; i < n; i++) {
+        virtio_disk_wait_mode(bufs[i], DISK_WAIT_INTR);
+    }
+}
+
+// 把一组 buffer 写回各自的位置：按块号排序后，连续的块合并成一个请求，
+// 所有请求一起挂到队列上再统一等待
+void fsbuf_write_sorted(struct fsbuf **bufs, int n) {
+    // 插入排序，n 不超过一个事务的块数
+    for (int i = 1; i < n; i++) {
+        struct fsbuf *b = bufs[i];
+        int j = i - 1;
+        while (j >= 0 && bufs[j]->blockno > b->blockno) {
+            bufs[j + 1] = bufs[j];
+            j--;
+        }
+        bufs[j + 1] = b;
+    }
+
+    for (int i = 0; i < n;) {
+        int j = i + 1;
+        while (j < n && bufs[j]->blockno == bufs[j - 1]->blockno + 1)
+            j++;
+        virtio_disk_submit_vec(bufs[i]->blockno, bufs + i, j - i, 1);
+        i = j;
+    }
+    for (int i = 0; i < n; i++) {
+        virtio_disk_wait_mode(bufs[i], DISK_WAIT_INTR);
+    }
+}
+
+// 预读：把 [blockno, blockno + n) 里还不在缓存中的块读进来
+// 连续的未命中块合并成一个请求，读完放回 LRU，之后的 fsbuf_read 直接命中
+void fsbuf_readahead(uint dev, uint blockno, int n) {
+    struct fsbuf *run[FSBUF_READAHEAD];
+    int cnt = 0;
+
+    if (n > FSBUF_READAHEAD)
+        n = FSBUF_READAHEAD;
+
+    for (int i = 0; i < n; i++) {
+        struct fsbuf *b = fsbuf_get(dev, blockno + i);
+        if (b->valid || b->lock.locked) {
+            // 已经在缓存里，或者别人正在用它，不打断对方
+            fsbuf_put(b);
+            continue;
+        }
+        sleeplock_acquire(&b->lock);
+        // 和前一个未命中的块不连续就先提交前面那一段
+        if (cnt > 0 && run[cnt - 1]->blockno + 1 != b->blockno) {
+            virtio_disk_submit_vec(run[0]->blockno, run, cnt, 0);
+            for (int j = 0; j < cnt; j++) {
+                virtio_disk_wait(run[j]);
+                fsbuf_release(run[j]);
+            }
+            cnt = 0;
+        }
+        run[cnt++] = b;
+    }
+    if (cnt > 0) {
+        virtio_disk_submit_vec(run[0]->blockno, run, cnt, 0);
+        for (int j = 0; j < cnt; j++) {
+            virtio_disk_wait(run[j]);
+            fsbuf_release(run[j]);
+        }
+    }
+}
+
 // 简单打印当前链表顺序
 void fsbuf_dump_list(void) {
     struct fsbuf *b;
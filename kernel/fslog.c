@@ -9,6 +9,20 @@ struct sleeplock log_lock;
 
 // 标记日志在磁盘的什么位置
 uint log_start_block;
+// 一个事务最多记多少块：超级块里的日志大小和日志头能记的取小的
+static int log_size;
+
+// 有序日志模式 (FS_FLAG_ORDERED)：数据块不进日志
+int fslog_ordered = 0;
+
+// 当前事务里等待写回原位的数据块（只在有序模式下使用）
+struct {
+    uint n;
+    uint block_nums[DATABLOCKS];
+} log_data;
+
+// 提交时暂存当前事务的 buffer 指针，事务在 log_lock 下串行，所以放在全局而不是栈上
+static struct fsbuf *log_bufs[FS_LOGMAX > DATABLOCKS ? FS_LOGMAX : DATABLOCKS];
 
 // 测试专用全局变量
 int FSLOG_TEST_CRASH = 0; // 0:正常, 1:写日志区时崩, 2:写完Header后崩(测恢复)
@@ -28,8 +42,12 @@ static void fslog_header_write() {
     fsbuf_release(bp);
 }
 
-// Install，把日志区的数据拷贝回数据块
+// Install，把日志区的数据拷贝回数据块（只在挂载时恢复用）
 static void fslog_install_trans() {
+    // 日志区是连续的，先整段预读进缓存，下面逐块读就都命中了
+    for (int i = 0; i < log_header.n; i += FSBUF_READAHEAD) {
+        fsbuf_readahead(ROOTDEV, log_start_block + i + 1, log_header.n - i);
+    }
     for (int i = 0; i < log_header.n; i++) {
         // 1. 读日志块 (Log Block)
         struct fsbuf *lbuf = fsbuf_read(ROOTDEV, log_start_block + i + 1);
@@ -44,53 +62,136 @@ static void fslog_install_trans() {
     }
 }
 
+// 把 block_nums 里的块全部锁住放进 log_bufs
+// 这些块都被 pin 在缓存里，fsbuf_read 不会真的读盘
+static void fslog_lock_bufs(uint *block_nums, int n) {
+    for (int i = 0; i < n; i++) {
+        log_bufs[i] = fsbuf_read(ROOTDEV, block_nums[i]);
+    }
+}
+
+static void fslog_release_bufs(int n, int unpin) {
+    for (int i = 0; i < n; i++) {
+        if (unpin)
+            fsbuf_unpin(log_bufs[i]);
+        fsbuf_release(log_bufs[i]);
+    }
+}
+
+// 把事务里前 n 个块写进日志区
+// 日志区是连续的，直接拿原位 buffer 的内存做分散-聚集写，不再经过日志块的 buffer 拷贝
+static void fslog_write_log(int n) {
+    fslog_lock_bufs(log_header.block_nums, n);
+    fsbuf_write_vec(log_start_block + 1, log_bufs, n);
+    fslog_release_bufs(n, 0);
+}
+
+// 提交后安装：日志里的内容和缓存里的原位 buffer 一样，直接把原位 buffer 排序后批量写回
+static void fslog_install_commit() {
+    fslog_lock_bufs(log_header.block_nums, log_header.n);
+    fsbuf_write_sorted(log_bufs, log_header.n);
+    fslog_release_bufs(log_header.n, 1); // 释放在 fslog_write 里增加的 refcnt
+}
+
 // 上层调用：把一个 buffer 加入当前事务（替代直接写盘）
 void fslog_write(struct fsbuf *b) {
-    if (log_header.n >= LOGBLOCKS) {
+    if (log_header.n >= log_size) {
         panic("fslog: transaction too big"); // 直接简单粗暴报错，防止溢出
     }
 
+    // 吸收：同一个事务里同一块只记一次，提交时写的是最后的内容
+    for (int i = 0; i < log_header.n; i++) {
+        if (log_header.block_nums[i] == b->blockno)
+            return;
+    }
+
     uint i = log_header.n;
     log_header.block_nums[i] = b->blockno; // 记录它本来是哪个块
     log_header.n++;
 
     // 把这个 buffer pin 住，不让 bio 层回收）
-    b->refcnt++;
+    fsbuf_pin(b);
 }
 
-void fslog_copy_to_log(int i) {
-    // 找到内存中缓存的那个 buffer
-    struct fsbuf *b = fsbuf_read(ROOTDEV, log_header.block_nums[i]); // 需确保 bio 有这个查找函数
+// 把暂存的数据块写回原位并解除 pin
+// 有序模式只要求数据先于引用它的元数据落盘，所以任何时候提前写回都是安全的
+static void fslog_flush_data() {
+    fslog_lock_bufs(log_data.block_nums, log_data.n);
+    fsbuf_write_sorted(log_bufs, log_data.n);
+    fslog_release_bufs(log_data.n, 1);
+    log_data.n = 0;
+}
 
-    // 读出日志区的目标块
-    struct fsbuf *lbuf = fsbuf_read(ROOTDEV, log_start_block + i + 1);
+// 上层调用：写普通文件的数据块
+// 默认模式下和 fslog_write 一样进日志；有序模式下只记下来，提交前直接写回原位
+void fslog_write_data(struct fsbuf *b) {
+    if (!fslog_ordered) {
+        fslog_write(b);
+        return;
+    }
+    // 同一个事务里反复写同一块只需要写回一次
+    for (int i = 0; i < log_data.n; i++) {
+        if (log_data.block_nums[i] == b->blockno)
+            return;
+    }
+    if (log_data.n >= DATABLOCKS) {
+        fslog_flush_data();
+    }
+    log_data.block_nums[log_data.n++] = b->blockno;
+    fsbuf_pin(b);
+}
 
-    // 拷贝数据
-    memmove(lbuf->data, b->data, BSIZE);
+// 从 block_nums 的前 *n 项里拿掉 blockno 并解除 pin
+static void fslog_drop(uint *block_nums, uint *n, uint blockno) {
+    for (uint i = 0; i < *n; i++) {
+        if (block_nums[i] == blockno) {
+            struct fsbuf *bp = fsbuf_read(ROOTDEV, blockno); // pin 着，不会读盘
+            fsbuf_unpin(bp);
+            fsbuf_release(bp);
+            block_nums[i] = block_nums[--*n];
+            return;
+        }
+    }
+}
 
-    fsbuf_write(lbuf); // 写日志区到磁盘
+// 上层调用：blockno 刚分给了页缓存里的文件数据，以后由页缓存直接写回原位
+// 当前事务里如果还记着它被释放前的内容（比如删掉的目录块），提交时会装回去盖掉新数据，要拿掉
+void fslog_forget(uint blockno) {
+    fslog_drop(log_header.block_nums, &log_header.n, blockno);
+    fslog_drop(log_data.block_nums, &log_data.n, blockno);
+}
 
-    fsbuf_release(lbuf);
-    fsbuf_release(b); // 释放在 fslog_write 里增加的 refcnt
+// 当前事务还能再记多少个元数据块
+int fslog_room() {
+    return log_size - log_header.n;
 }
 
 // 核心流程：提交事务
+// 一般由 fslog_op_end 调用；长操作（比如截断大文件）也可以在一致的中间状态提前提交一部分
+
 void fslog_commit() {
+    // 当前事务新分配了块的文件页先落盘（数据日志模式下放得下就进日志）
+    pcache_commit();
+
+    // 空闲计数变了的话，超级块和 bitmap/inode 的修改进同一个事务
+    fs_sb_flush();
+
+    // 步骤 0: 有序模式下数据块必须先于引用它们的元数据落盘
+    if (log_data.n > 0) {
+        fslog_flush_data();
+    }
+
     if (log_header.n > 0) {
         // --- 模拟场景 A: 写日志写一半断电 ---
         if (FSLOG_TEST_CRASH == 1) {
             printf("TEST: Crashing during log write...\n");
             // 只写一半的日志块
-            for (int i = 0; i < log_header.n / 2; i++) {
-                fslog_copy_to_log(i);
-            }
+            fslog_write_log(log_header.n / 2);
             panic("CRASH: Power failure during log write!");
         }
 
         // 步骤 1: 把所有被修改的 buffer 写入磁盘的日志区 (Write Log Blocks)
-        for (int i = 0; i < log_header.n; i++) {
-            fslog_copy_to_log(i);
-        }
+        fslog_write_log(log_header.n);
 
         // 步骤 2: 写日志头 - 保证是一整块操作的原子操作
         fslog_header_write();
@@ -101,7 +202,7 @@ void fslog_commit() {
         }
 
         // 步骤 3: 安装事务 (Install) - 把数据搬到真正的位置
-        fslog_install_trans();
+        fslog_install_commit();
 
         // 步骤 4: 清除日志头 (Clean)
         log_header.n = 0;
@@ -110,12 +211,19 @@ void fslog_commit() {
 }
 
 // 初始化，检查日志，进行恢复重做
-void fslog_init(int dev, struct superblock *sb, int debug) {
+// 返回 1 表示上次没有正常关机，重放了日志
+int fslog_init(int dev, struct superblock *sb, int debug) {
     log_start_block = sb->logstart;
+    log_size = sb->nlog - 1 < FS_LOGMAX ? sb->nlog - 1 : FS_LOGMAX;
+    if (log_size < MAXOPBLOCKS)
+        panic("fslog_init: log too small");
+    fslog_ordered = (sb->flags & FS_FLAG_ORDERED) != 0;
+    log_data.n = 0;
     sleeplock_init(&log_lock, "fslog"); // 初始化锁
     // 检查磁盘上的日志头
     struct fsbuf *bp = fsbuf_read(dev, log_start_block);
     struct fslog_header *hb = (struct fslog_header *) (bp->data);
+    int replayed = hb->n > 0;
 
     // 如果头里 n > 0，说明上次断电了，需要重放
     if (hb->n > 0) {
@@ -135,6 +243,7 @@ void fslog_init(int dev, struct superblock *sb, int debug) {
     }
 
     fsbuf_release(bp);
+    return replayed;
 }
 
 // 日志开始
@@ -142,7 +251,7 @@ void fslog_op_begin() {
     // 获取锁，如果其他进程拿着锁正在 sleep 等磁盘，走到这里会 sleep 等锁
     // 不支持开启多个事务
     sleeplock_acquire(&log_lock);
-    if (log_header.n != 0)
+    if (log_header.n != 0 || log_data.n != 0)
         panic("fslog_op_begin: nesting not supported");
 }
 
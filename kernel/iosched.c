@@ -0,0 +1,142 @@
+#include "../include/fs.h"
+#include "../include/param.h"
+#include "../include/printf.h"
+#include "../include/riscv.h"
+#include "../include/sysinfo.h"
+#include "../include/virtio.h"
+
+// 块 I/O 调度器：夹在 fsbuf_read/fsbuf_write 和 virtio 驱动之间
+// 设备上在飞的请求够多时，新请求先进队列；设备空出来后按电梯顺序取，
+// 相邻块号、同方向的请求合并成一个多段请求一起下发
+// 队列里等太久的请求（超过 IOSCHED_DEADLINE）优先下发，防止饿死
+
+// 一个排队中的请求
+struct ioreq {
+    struct fsbuf *b;
+    int write;
+    uint64 arrive; // 入队时间
+    int used;
+};
+
+static struct {
+    struct ioreq q[IOSCHED_QUEUE];
+    int n; // 队列里的请求数
+    uint last_blockno; // 上一次下发到哪个块号，电梯从这里往上扫
+    int dispatching; // 防止完成回调里重入
+
+    uint64 queued; // 进过队列的请求数
+    uint64 dispatched; // 下发给设备的请求数（合并后）
+    uint64 merged; // 被合并进别的请求的块数
+    uint64 expired; // 因为超时被提前下发的次数
+    uint64 max_depth; // 队列最深到过多少
+} sched;
+
+// 找块号为 blockno、方向为 write 的排队请求
+static struct ioreq *iosched_find(uint blockno, int write) {
+    for (int i = 0; i < IOSCHED_QUEUE; i++) {
+        struct ioreq *r = &sched.q[i];
+        if (r->used && r->write == write && r->b->blockno == blockno)
+            return r;
+    }
+    return 0;
+}
+
+// 选下一个下发的请求：有超时的先发最老的，否则 C-LOOK 电梯
+// 取块号 >= last_blockno 里最小的，没有就绕回最小块号
+static struct ioreq *iosched_pick() {
+    struct ioreq *oldest = 0, *up = 0, *low = 0;
+    for (int i = 0; i < IOSCHED_QUEUE; i++) {
+        struct ioreq *r = &sched.q[i];
+        if (!r->used)
+            continue;
+        if (oldest == 0 || r->arrive < oldest->arrive)
+            oldest = r;
+        if (r->b->blockno >= sched.last_blockno && (up == 0 || r->b->blockno < up->b->blockno))
+            up = r;
+        if (low == 0 || r->b->blockno < low->b->blockno)
+            low = r;
+    }
+    if (oldest && r_time() - oldest->arrive > IOSCHED_DEADLINE) {
+        sched.expired++;
+        return oldest;
+    }
+    return up ? up : low;
+}
+
+// 设备有空就把队列里的请求往下发
+// 由提交路径和 virtio 完成回调调用，不会睡眠
+void iosched_dispatch() {
+    struct fsbuf *bufs[VIRTIO_MAXSEG];
+
+    if (sched.dispatching)
+        return;
+    sched.dispatching = 1;
+
+    int maxseg = virtio_disk_maxseg();
+    while (sched.n > 0 && virtio_disk_inflight() < IOSCHED_DEPTH && virtio_disk_can_submit(maxseg)) {
+        struct ioreq *r = iosched_pick();
+        int write = r->write;
+
+        // 往前找连续块，合并后的请求从最小的块号开始
+        uint start = r->b->blockno;
+        while (start > 0 && iosched_find(start - 1, write))
+            start--;
+
+        int n = 0;
+        struct ioreq *e;
+        while (n < maxseg && (e = iosched_find(start + n, write)) != 0) {
+            bufs[n++] = e->b;
+            e->used = 0;
+            sched.n--;
+        }
+
+        sched.dispatched++;
+        sched.merged += n - 1;
+        sched.last_blockno = start + n;
+        virtio_disk_submit_vec(start, bufs, n, write);
+    }
+
+    sched.dispatching = 0;
+}
+
+// 提交一个单块请求，不等待完成
+// 和 virtio_disk_submit 一样，完成后 b->disk 清 0 并 wakeup(b)
+void iosched_submit(struct fsbuf *b, int write) {
+    if (sched.n >= IOSCHED_QUEUE) {
+        // 队列满了就不排队，直接交给驱动
+        virtio_disk_submit(b, write);
+        return;
+    }
+
+    int i = 0;
+    while (sched.q[i].used)
+        i++;
+    sched.q[i].b = b;
+    sched.q[i].write = write;
+    sched.q[i].arrive = r_time();
+    sched.q[i].used = 1;
+    sched.n++;
+    b->disk = 1; // 还在队列里也算没完成，等待者据此睡眠
+
+    sched.queued++;
+    if (sched.n > sched.max_depth)
+        sched.max_depth = sched.n;
+
+    iosched_dispatch();
+}
+
+// 经过调度器读写一块并等待完成
+void iosched_rw(struct fsbuf *b, int write) {
+    iosched_submit(b, write);
+    virtio_disk_wait(b);
+}
+
+// 填调度器的统计
+void iosched_stat(struct diskstat *st) {
+    st->sched_queued = sched.queued;
+    st->sched_dispatched = sched.dispatched;
+    st->sched_merged = sched.merged;
+    st->sched_expired = sched.expired;
+    st->sched_depth = sched.n;
+    st->sched_max_depth = sched.max_depth;
+}
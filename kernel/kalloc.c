@@ -3,6 +3,7 @@
 #include "../include/types.h"
 #include "../include/printf.h"
 #include "../include/string.h"
+#include "../include/fs.h"
 
 // 空闲页节点，下一页的地址存放在当前空闲页的前8个字节中
 struct node {
@@ -12,6 +13,7 @@ struct node {
 // 头节点
 struct {
     struct node *head;
+    uint64 n; // 空闲页数
 } freelist = {0};
 
 // 链接器脚本 kernel.ld 提供的内核代码和数据的末尾地址
@@ -32,27 +34,40 @@ void kmem_free(void *phys_addr) {
     // 头插法将页加入空闲链表
     mem_node->next = freelist.head;
     freelist.head = mem_node;
+    freelist.n++;
 }
 
 // 申请一页物理内存，返回页的起始地址
-// 如果没有空闲页，则触发panic
-void *kmem_alloc(void) {
+// 没有空闲页时先让页缓存交出一批干净的页，还没有就返回 0
+void *kmem_try_alloc(void) {
     // 分配：从链表头摘下来一个节点，如果不是0，说明是有空闲的页
     struct node *mem_node;
     mem_node = freelist.head;
+    if (mem_node == 0 && pcache_shrink() > 0)
+        mem_node = freelist.head;
     if (mem_node) {
         freelist.head = mem_node->next;
+        freelist.n--;
         // 填充数据0
         memset((char *) mem_node, 0, PAGE_SIZE);
-    } else {
-        // 物理内存用完了
-        panic("kmem_alloc: out of memory");
-        return 0;
     }
-    // 返回页的起始地址
+    // 返回页的起始地址，物理内存用完了是 0
     return mem_node;
 }
 
+// 和 kmem_try_alloc 一样，但物理内存用完了直接 panic，给没法处理失败的内核路径用
+void *kmem_alloc(void) {
+    void *pa = kmem_try_alloc();
+    if (pa == 0)
+        panic("kmem_alloc: out of memory");
+    return pa;
+}
+
+// 当前空闲页数，给按内存大小决定缓存容量的模块用
+uint64 kmem_free_pages(void) {
+    return freelist.n;
+}
+
 // 传进来的参数很可能没对齐
 static void freerange(void *physical_addr_start, void *physical_addr_end) {
     char *p = (char *) PAGE_UP((uint64)physical_addr_start);
@@ -28,6 +28,9 @@ int main(void) {
 
     // 创建第一个用户进程
     proc_userinit();
+    // 页缓存的写回线程
+    if (kproc_create(pcache_flusher) == 0)
+        panic("main: pflush");
 
     // 3. 启动调度器
     //    注意：这一步是单行道。
@@ -0,0 +1,672 @@
+#include "../include/fs.h"
+#include "../include/kalloc.h"
+#include "../include/param.h"
+#include "../include/printf.h"
+#include "../include/proc.h"
+#include "../include/string.h"
+#include "../include/vm.h"
+
+// 页缓存：普通文件的数据按页缓存在这里，fsbuf 只剩元数据（bitmap、inode、间接块、目录）
+// 每个 inode 一棵基数树，按文件内的页号找页；读文件和预读把页填进来，写文件只改页并标脏，
+// pflush 内核线程定期把脏页写回。页上记着每块的物理块号，写回直接按块号发请求，
+// 不用拿 inode 锁，所以内存紧张时任何路径都能就地写回、回收别的文件的页
+// 有序模式：用了当前事务新分配的块的页，在引用这些块的元数据提交前写回（fslog_commit 开头调 pcache_commit）
+// 数据日志模式：当前事务写过的页都随元数据一起进日志，写得太多日志放不下时分几个事务提交
+// mmap 的文件映射直接把缓存页映射给用户，映射期间页一直被占着
+
+#if BSIZE > PAGE_SIZE
+#error "BSIZE must not be larger than PAGE_SIZE"
+#endif
+
+#define min(a, b) ((a) < (b) ? (a) : (b))
+
+#define PCACHE_BPP (PAGE_SIZE / BSIZE) // 一页几块
+#define PCACHE_SHIFT 9 // 基数树每层按页号的 9 位分叉
+#define PCACHE_FANOUT (1 << PCACHE_SHIFT) // 树节点就是一页，放 512 个指针
+
+// 页的状态
+#define PG_VALID 0x1 // 内容有效
+#define PG_DIRTY 0x2 // 比盘上新，要写回
+#define PG_IO 0x4 // 有请求在飞：VALID 为 0 是在读盘，否则是在写回
+#define PG_TXN 0x8 // 属于当前事务（用了新分配的块，数据日志模式下还有写过的页），提交时落盘
+#define PG_WAIT 0x10 // 有人在等这页的引用放完
+#define PG_BUSY (PG_DIRTY | PG_IO | PG_TXN) // 这些页不能直接丢
+
+#define PCACHE_TXN_SLACK 8 // 事务里再写一页，元数据（bitmap、间接块、inode、超级块）最多再占几块日志
+
+// 缓存的一页
+struct pcpage {
+    struct inode *ip; // 属于哪个文件
+    uint index; // 文件内页号
+    uint flags; // PG_*
+    uint ref; // 正在用这页的人数，大于 0 不回收
+    char *data; // 一页物理内存
+    struct pcpage *prev; // 全局 LRU，lru.next 是最近用过的
+    struct pcpage *next;
+    struct pcpage *nnext; // 当前事务的页链表 / 空闲描述符链表
+    struct fsbuf io[PCACHE_BPP]; // 每块一个请求头，data 指向页里对应的位置，blockno 为 0 是空洞
+};
+
+// 描述符按需从物理页里切，页数上限在初始化时按空闲内存算出来
+static struct {
+    struct pcpage lru; // LRU 哨兵
+    struct pcpage *free; // 空闲描述符
+    char *page; // 正在切的页
+    int page_left; // 这页还能切几个
+    uint n; // 带着数据页的描述符数，也就是缓存了几页
+    uint max; // 页数上限
+    uint ndirty; // 脏页数
+    struct pcpage *txnq; // 当前事务的页
+    uint ntxn; // txnq 上有几页
+} pcache;
+
+extern int fslog_ordered;
+extern volatile uint ticks;
+
+void pcache_init(void) {
+    pcache.lru.next = pcache.lru.prev = &pcache.lru;
+    pcache.max = kmem_free_pages() / PCACHE_MEM_FRACTION;
+    if (pcache.max < PCACHE_SCAN)
+        pcache.max = PCACHE_SCAN;
+    printf("pcache_init: page cache up to %d pages\n", pcache.max);
+}
+
+// ---------------- 基数树 ----------------
+
+// 找第 index 页在树里的槽位；create 时树不够高先长高，路上缺的节点补上，否则缺了返回 0
+// 回收页只清叶子槽位，树节点等截断或者 inode 被回收时才一起释放，所以拿到的槽位睡眠后仍然有效
+static struct pcpage **pcache_slot(struct inode *ip, uint index, int create) {
+    while (ip->pc_height == 0 || (index >> (PCACHE_SHIFT * ip->pc_height)) != 0) {
+        if (!create)
+            return 0;
+        void **node = kmem_alloc();
+        node[0] = ip->pc_root;
+        ip->pc_root = node;
+        ip->pc_height++;
+    }
+    void **node = ip->pc_root;
+    for (int h = ip->pc_height; h > 1; h--) {
+        void **slot = &node[(index >> (PCACHE_SHIFT * (h - 1))) & (PCACHE_FANOUT - 1)];
+        if (*slot == 0) {
+            if (!create)
+                return 0;
+            *slot = kmem_alloc();
+        }
+        node = *slot;
+    }
+    return (struct pcpage **) &node[index & (PCACHE_FANOUT - 1)];
+}
+
+static struct pcpage *pcache_lookup(struct inode *ip, uint index) {
+    struct pcpage **slot = pcache_slot(ip, index, 0);
+    return slot ? *slot : 0;
+}
+
+// 对树里每一页调 fn，fn 可以睡眠也可以把页从树里摘掉
+static void pcache_walk(void **node, int h, void (*fn)(struct pcpage *)) {
+    for (int i = 0; i < PCACHE_FANOUT; i++) {
+        if (node[i] == 0)
+            continue;
+        if (h > 1)
+            pcache_walk(node[i], h - 1, fn);
+        else
+            fn(node[i]);
+    }
+}
+
+static void pcache_free_tree(void **node, int h) {
+    if (h > 1) {
+        for (int i = 0; i < PCACHE_FANOUT; i++) {
+            if (node[i])
+                pcache_free_tree(node[i], h - 1);
+        }
+    }
+    kmem_free(node);
+}
+
+// ---------------- 页的状态和 LRU ----------------
+
+// 改页的状态，顺带维护脏页数、事务页数和 inode 的 pc_nbusy
+static void pcache_flags(struct pcpage *pg, uint set, uint clear) {
+    uint old = pg->flags;
+    pg->flags = (old | set) & ~clear;
+    if ((old & PG_DIRTY) != (pg->flags & PG_DIRTY))
+        pcache.ndirty += (pg->flags & PG_DIRTY) ? 1 : -1;
+    if ((old & PG_TXN) != (pg->flags & PG_TXN))
+        pcache.ntxn += (pg->flags & PG_TXN) ? 1 : -1;
+    if (((old & PG_BUSY) != 0) != ((pg->flags & PG_BUSY) != 0))
+        pg->ip->pc_nbusy += (pg->flags & PG_BUSY) ? 1 : -1;
+}
+
+static void pcache_lru_remove(struct pcpage *pg) {
+    pg->prev->next = pg->next;
+    pg->next->prev = pg->prev;
+}
+
+static void pcache_lru_head(struct pcpage *pg) {
+    pg->next = pcache.lru.next;
+    pg->prev = &pcache.lru;
+    pcache.lru.next->prev = pg;
+    pcache.lru.next = pg;
+}
+
+// 从所属文件的树和 LRU 上摘下来，描述符和数据页留给调用者
+static void pcache_unhook(struct pcpage *pg) {
+    if (pg->flags & PG_TXN) {
+        struct pcpage **pp = &pcache.txnq;
+        while (*pp != pg)
+            pp = &(*pp)->nnext;
+        *pp = pg->nnext;
+    }
+    pcache_flags(pg, 0, pg->flags);
+    *pcache_slot(pg->ip, pg->index, 0) = 0;
+    pg->ip->pc_npages--;
+    pcache_lru_remove(pg);
+}
+
+// 彻底释放一页
+static void pcache_free(struct pcpage *pg) {
+    pcache_unhook(pg);
+    kmem_free(pg->data);
+    pg->nnext = pcache.free;
+    pcache.free = pg;
+    pcache.n--;
+}
+
+// 没人用、干净、没有 I/O 的页可以直接丢
+static int pcache_idle(struct pcpage *pg) {
+    return pg->ref == 0 && (pg->flags & PG_BUSY) == 0;
+}
+
+// 放掉引用，最后一个放掉时叫醒等着截断这个文件的进程
+static void pcache_put(struct pcpage *pg) {
+    if (--pg->ref == 0 && (pg->flags & PG_WAIT)) {
+        pcache_flags(pg, 0, PG_WAIT);
+        wakeup(pg);
+    }
+}
+
+// ---------------- 页的 I/O ----------------
+
+// 对页里有块的部分发请求，不等待
+static void pcache_submit(struct pcpage *pg, int write) {
+    for (int k = 0; k < PCACHE_BPP; k++) {
+        if (pg->io[k].blockno)
+            iosched_submit(&pg->io[k], write);
+    }
+}
+
+// 开始写回一页：先清脏，写回期间又被改的话会重新标脏
+static void pcache_write_start(struct pcpage *pg) {
+    pcache_flags(pg, PG_IO, PG_DIRTY);
+    pcache_submit(pg, 1);
+}
+
+// 等页上在飞的请求完成；读盘的页到这里才算有效
+// 发请求的人不等，谁先用到这页谁收尾，调用者要持有这一页的引用
+static void pcache_settle(struct pcpage *pg) {
+    if (!(pg->flags & PG_IO))
+        return;
+    for (int k = 0; k < PCACHE_BPP; k++) {
+        if (pg->io[k].blockno)
+            virtio_disk_wait(&pg->io[k]);
+    }
+    if (pg->flags & PG_IO)
+        pcache_flags(pg, PG_VALID, PG_IO);
+}
+
+// 查块号并把页填上：空洞部分填 0，有块的发读请求（不等待）
+// 全是空洞的页不用读盘，直接就有效了
+static void pcache_fill(struct pcpage *pg, int read) {
+    struct inode *ip = pg->ip;
+    int any = 0;
+    for (int k = 0; k < PCACHE_BPP; k++) {
+        uint bn = pg->index * PCACHE_BPP + k;
+        struct fsbuf *b = &pg->io[k];
+        b->dev = ip->dev;
+        b->blockno = (uint64) bn * BSIZE < ip->size ? fs_inode_bmap(ip, bn) : 0;
+        b->data = (uchar *) pg->data + k * BSIZE;
+        b->disk = 0;
+        if (b->blockno == 0 || !read)
+            memset(b->data, 0, BSIZE);
+        else
+            any = 1;
+    }
+    if (!read)
+        return;
+    if (any) {
+        pcache_flags(pg, PG_IO, 0);
+        pcache_submit(pg, 0);
+    } else {
+        pcache_flags(pg, PG_VALID, 0);
+    }
+}
+
+// ---------------- 分配和回收 ----------------
+
+// 把 pgs 里的脏页一起写回并等完成
+static void pcache_write_batch(struct pcpage **pgs, int n) {
+    for (int i = 0; i < n; i++) {
+        pgs[i]->ref++;
+        if ((pgs[i]->flags & PG_DIRTY) && !(pgs[i]->flags & PG_IO))
+            pcache_write_start(pgs[i]);
+    }
+    for (int i = 0; i < n; i++) {
+        pcache_settle(pgs[i]);
+        pcache_put(pgs[i]);
+    }
+}
+
+// 页数到上限了：从 LRU 尾部找一个干净的页，摘下来连数据页一起复用
+// 尾部 PCACHE_SCAN 页里都是脏页的话，先把它们写回（写得太快的进程在这里被拖慢）再找一遍
+// 数据日志模式下当前事务的页要等提交时进日志，不能提前写回原位
+static struct pcpage *pcache_reclaim(void) {
+    struct pcpage *dirty[PCACHE_SCAN];
+    for (int pass = 0; pass < 2; pass++) {
+        int n = 0, scanned = 0;
+        for (struct pcpage *pg = pcache.lru.prev; pg != &pcache.lru && scanned < PCACHE_SCAN; pg = pg->prev, scanned++) {
+            if (pcache_idle(pg)) {
+                pcache_unhook(pg);
+                return pg;
+            }
+            if (pg->ref == 0 && (pg->flags & PG_DIRTY) && (fslog_ordered || !(pg->flags & PG_TXN)))
+                dirty[n++] = pg;
+        }
+        if (n == 0)
+            break;
+        pcache_write_batch(dirty, n);
+    }
+    return 0;
+}
+
+// 内存不够时由 kmem_alloc 调用：从 LRU 尾部释放一批干净的页，不睡眠，返回释放了几页
+int pcache_shrink(void) {
+    int freed = 0;
+    struct pcpage *pg = pcache.lru.prev;
+    while (pg != &pcache.lru && freed < PCACHE_SCAN) {
+        struct pcpage *prev = pg->prev;
+        if (pcache_idle(pg)) {
+            pcache_free(pg);
+            freed++;
+        }
+        pg = prev;
+    }
+    return freed;
+}
+
+// 给 ip 的第 index 页新建一个缓存页（调用者持有 inode 锁，确认了树里没有），返回时 ref 为 1，内容还没填
+static struct pcpage *pcache_new(struct inode *ip, uint index) {
+    struct pcpage *pg = 0;
+    if (pcache.n >= pcache.max)
+        pg = pcache_reclaim();
+    if (pg == 0) {
+        if (pcache.free) {
+            pg = pcache.free;
+            pcache.free = pg->nnext;
+        } else {
+            if (pcache.page_left == 0) {
+                pcache.page = kmem_alloc();
+                pcache.page_left = PAGE_SIZE / sizeof(struct pcpage);
+            }
+            pg = (struct pcpage *) pcache.page;
+            pcache.page += sizeof(struct pcpage);
+            pcache.page_left--;
+        }
+        pg->data = kmem_alloc();
+        pcache.n++;
+    }
+    pg->ip = ip;
+    pg->index = index;
+    pg->flags = 0;
+    pg->ref = 1;
+    pg->nnext = 0;
+    *pcache_slot(ip, index, 1) = pg;
+    ip->pc_npages++;
+    pcache_lru_head(pg);
+    return pg;
+}
+
+// 拿 ip 的第 index 页，引用计数 +1，调用者持有 inode 锁
+// fill 为 1 时保证内容有效；为 0 时新建的页只查好块号、清零，不读盘（调用者马上要整段覆盖）
+static struct pcpage *pcache_get(struct inode *ip, uint index, int fill) {
+    struct pcpage *pg = pcache_lookup(ip, index);
+    if (pg) {
+        pg->ref++;
+        pcache_lru_remove(pg);
+        pcache_lru_head(pg);
+        pcache_settle(pg);
+        return pg;
+    }
+    pg = pcache_new(ip, index);
+    pcache_fill(pg, fill);
+    pcache_settle(pg);
+    return pg;
+}
+
+// 把页挂到当前事务上，提交时落盘
+static void pcache_txn_add(struct pcpage *pg) {
+    if (pg->flags & PG_TXN)
+        return;
+    pg->nnext = pcache.txnq;
+    pcache.txnq = pg;
+    pcache_flags(pg, PG_TXN, 0);
+}
+
+// 页里第 first 到 last 块中还是空洞的，分配成物理连续的一段（块号进页，bitmap 和块映射随当前事务提交）
+// 这些块以前可能是别的文件的元数据，当前事务里还记着它们被释放前的内容的话要拿掉
+// 分配了块的页进当前事务，调用者持有 inode 锁且在事务里
+static void pcache_alloc_blocks(struct pcpage *pg, uint first, uint last) {
+    int fresh = 0;
+    for (uint k = first; k <= last;) {
+        if (pg->io[k].blockno) {
+            k++;
+            continue;
+        }
+        uint want = 1, got;
+        while (k + want <= last && pg->io[k + want].blockno == 0)
+            want++;
+        uint addr = fs_inode_alloc_run(pg->ip, pg->index * PCACHE_BPP + k, want, &got);
+        for (uint j = 0; j < got; j++) {
+            pg->io[k + j].blockno = addr + j;
+            fslog_forget(addr + j);
+        }
+        k += got;
+        fresh = 1;
+    }
+    if (fresh)
+        pcache_txn_add(pg);
+}
+
+// 页写过了：标脏，数据日志模式下进当前事务
+static void pcache_dirty(struct pcpage *pg) {
+    pcache_flags(pg, PG_VALID | PG_DIRTY, 0);
+    if (!fslog_ordered)
+        pcache_txn_add(pg);
+}
+
+// 当前事务再写一页的话日志可能放不下了，调用者应该在一致的状态下先提交一次
+// 有序模式下只算元数据，数据日志模式下还要算事务里每页的数据块
+int pcache_txn_full(void) {
+    int need = PCACHE_TXN_SLACK;
+    if (!fslog_ordered)
+        need += (pcache.ntxn + 1) * PCACHE_BPP;
+    return fslog_room() < need;
+}
+
+// ---------------- 读写文件 ----------------
+
+// 预读 [start, end) 里还没缓存的页：只发请求不等，物理连续的块在调度器里合并
+static void pcache_readahead(struct inode *ip, uint start, uint end) {
+    for (uint index = start; index < end; index++) {
+        if (pcache_lookup(ip, index))
+            continue;
+        struct pcpage *pg = pcache_new(ip, index);
+        pcache_fill(pg, 1);
+        pcache_put(pg);
+    }
+    ip->ra_end = end;
+}
+
+// 从普通文件读，调用者已经持有 inode 锁并按文件大小截好了 n
+int pcache_read(struct inode *ip, int is_user_addr, char *dst, uint off, uint n) {
+    uint tot, m;
+
+    // 读到了预读窗口之外：本次要读的页一起发请求，如果是接着上次往后读，再多读 FS_READAHEAD 页
+    if (n > 0) {
+        uint first = off / PAGE_SIZE;
+        uint last = (off + n - 1) / PAGE_SIZE;
+        if (last >= ip->ra_end) {
+            uint npages = (ip->size + PAGE_SIZE - 1) / PAGE_SIZE;
+            uint end = last + 1;
+            if (first <= ip->ra_end)
+                end = min(end + FS_READAHEAD, npages);
+            pcache_readahead(ip, first, end);
+        }
+    }
+
+    for (tot = 0; tot < n; tot += m, off += m, dst += m) {
+        m = min(n - tot, PAGE_SIZE - off % PAGE_SIZE);
+        struct pcpage *pg = pcache_get(ip, off / PAGE_SIZE, 1);
+        if (is_user_addr)
+            vmem_copyout(proc_running()->pagetable, (uint64) dst, pg->data + off % PAGE_SIZE, m);
+        else
+            memmove(dst, pg->data + off % PAGE_SIZE, m);
+        pcache_put(pg);
+    }
+    return tot;
+}
+
+// 写普通文件：数据只拷进页里并标脏，缺的块当场分配（块号进页，bitmap 和块映射随当前事务提交）
+// 新分配的块不清零：页里不会被覆盖的部分本来就是 0，提交前整块写回
+// 一次写得太多、日志放不下时，先更新文件大小，把已经写好的部分作为一个完整的事务提交
+// 返回实际写了多少字节，文件大小由调用者更新
+int pcache_write(struct inode *ip, int is_user_addr, char *src, uint off, uint n) {
+    uint tot, m;
+
+    // 文件要变长：原来末尾那页要是映射着，用户可能写过文件末尾之后的部分，这些字节要成为文件内容了，先清零
+    if (off + n > ip->size && ip->size % PAGE_SIZE) {
+        struct pcpage *pg = pcache_lookup(ip, ip->size / PAGE_SIZE);
+        if (pg && pg->ref)
+            memset(pg->data + ip->size % PAGE_SIZE, 0, PAGE_SIZE - ip->size % PAGE_SIZE);
+    }
+
+    for (tot = 0; tot < n; tot += m, off += m, src += m) {
+        uint index = off / PAGE_SIZE;
+        uint poff = off % PAGE_SIZE;
+        m = min(n - tot, PAGE_SIZE - poff);
+
+        if (pcache_txn_full()) {
+            if (off > ip->size) {
+                ip->size = off;
+                fs_inode_write(ip);
+            }
+            fslog_commit();
+        }
+
+        // 整页覆盖，或者从页头一直写到文件末尾之后，原来的内容用不上，不用读盘
+        uint64 pstart = (uint64) index * PAGE_SIZE;
+        int whole = pstart >= ip->size || (poff == 0 && (m == PAGE_SIZE || off + m >= ip->size));
+        struct pcpage *pg = pcache_get(ip, index, !whole);
+
+        int bad = 0;
+        if (is_user_addr)
+            bad = vmem_copyin(proc_running()->pagetable, pg->data + poff, (uint64) src, m) < 0;
+        else
+            memmove(pg->data + poff, src, m);
+        if (bad) {
+            // 没读过盘的页内容不完整，不能留在缓存里
+            if (!(pg->flags & PG_VALID)) {
+                pcache_put(pg);
+                pcache_free(pg);
+            } else {
+                pcache_put(pg);
+            }
+            break;
+        }
+
+        pcache_alloc_blocks(pg, poff / BSIZE, (poff + m - 1) / BSIZE);
+        pcache_dirty(pg);
+        pcache_put(pg);
+    }
+    return tot;
+}
+
+// ---------------- 映射到用户空间 ----------------
+
+// mmap 缺页：拿 ip 的第 index 页并一直占着，返回数据页，调用者持有 inode 锁
+// 映射着的页引用计数不为 0，不会被回收；用户通过映射改了内容不会标脏，解除映射时才算
+char *pcache_map(struct inode *ip, uint index) {
+    return pcache_get(ip, index, 1)->data;
+}
+
+// fork 时子进程也映射了这页，多占一次
+void pcache_dup(struct inode *ip, uint index) {
+    struct pcpage *pg = pcache_lookup(ip, index);
+    if (pg == 0)
+        panic("pcache_dup: page not mapped");
+    pg->ref++;
+}
+
+// 解除一页映射。dirty 表示用户可能写过：文件末尾之后的部分清零（不属于文件），
+// 还是空洞的块当场分配，页标脏等提交或者 pflush 写回，这时调用者持有 inode 锁且在事务里
+void pcache_unmap(struct inode *ip, uint index, int dirty) {
+    struct pcpage *pg = pcache_lookup(ip, index);
+    if (pg == 0)
+        panic("pcache_unmap: page not mapped");
+    uint64 pstart = (uint64) index * PAGE_SIZE;
+    if (dirty && pstart < ip->size) {
+        uint len = min(ip->size - pstart, PAGE_SIZE);
+        memset(pg->data + len, 0, PAGE_SIZE - len);
+        pcache_alloc_blocks(pg, 0, (len - 1) / BSIZE);
+        pcache_dirty(pg);
+    }
+    pcache_put(pg);
+}
+
+// ---------------- 截断、回收 inode ----------------
+
+static int pcache_settled; // pcache_settle_one 这一遍等了几页；pcache_count_ref 数出来有几页被占着
+
+// pflush、回收页不拿 inode 锁，会占着页睡眠等别的页的 I/O，I/O 做完了也要等它们放掉引用
+// 睡醒后这页可能已经被回收，不能再碰，由下一遍重新找
+static void pcache_settle_one(struct pcpage *pg) {
+    if (pg->flags & PG_IO) {
+        pg->ref++;
+        pcache_settle(pg);
+        pcache_put(pg);
+        pcache_settled++;
+    } else if (pg->ref > 0) {
+        pcache_flags(pg, PG_WAIT, 0);
+        sleep(pg);
+        pcache_settled++;
+    }
+}
+
+static void pcache_count_ref(struct pcpage *pg) {
+    if (pg->ref > 0)
+        pcache_settled++;
+}
+
+static void pcache_drop_one(struct pcpage *pg) {
+    if (pg->ref != 0)
+        panic("pcache_drop: page in use");
+    pcache_free(pg);
+}
+
+static void pcache_drop_all(struct inode *ip) {
+    if (ip->pc_root) {
+        pcache_walk(ip->pc_root, ip->pc_height, pcache_drop_one);
+        pcache_free_tree(ip->pc_root, ip->pc_height);
+    }
+    ip->pc_root = 0;
+    ip->pc_height = 0;
+}
+
+// 文件的块要被释放了：先等它的页上在飞的 I/O 做完、别人的引用放完，再连脏页一起全部丢掉
+// 调用者持有 inode 锁；等的时候 pflush 可能又开始写别的页，所以等到一遍下来什么都不用等为止
+void pcache_truncate(struct inode *ip) {
+    if (ip->pc_root == 0)
+        return;
+    do {
+        pcache_settled = 0;
+        pcache_walk(ip->pc_root, ip->pc_height, pcache_settle_one);
+    } while (pcache_settled > 0);
+    pcache_drop_all(ip);
+}
+
+// inode 槽位要被复用：干净的页直接丢掉返回 0；还有脏页、I/O 或者页被 pflush、回收占着的返回 -1，换一个 inode
+int pcache_evict(struct inode *ip) {
+    if (ip->pc_nbusy > 0)
+        return -1;
+    if (ip->pc_root) {
+        pcache_settled = 0;
+        pcache_walk(ip->pc_root, ip->pc_height, pcache_count_ref);
+        if (pcache_settled > 0)
+            return -1;
+    }
+    pcache_drop_all(ip);
+    return 0;
+}
+
+// ---------------- 提交和写回 ----------------
+
+// 提交事务前由日志层调用：当前事务的页必须先落盘
+// 数据日志模式（没有 FS_FLAG_ORDERED）下记进日志，和元数据一起原子地生效；
+// 有序模式下、或者日志实在放不下时直接写回原位
+void pcache_commit(void) {
+    if (pcache.txnq == 0)
+        return;
+    int room = fslog_room() - 1; // 给超级块留一块
+
+    // 先占住所有页再等 pflush、回收正在写的页写完：占着的事务页不会再有人开始写
+    struct pcpage *pg;
+    for (pg = pcache.txnq; pg; pg = pg->nnext)
+        pg->ref++;
+    for (pg = pcache.txnq; pg; pg = pg->nnext)
+        pcache_settle(pg);
+
+    for (pg = pcache.txnq; pg; pg = pg->nnext) {
+        if (!(pg->flags & PG_DIRTY))
+            continue;
+        if (!fslog_ordered && room >= PCACHE_BPP) {
+            for (int k = 0; k < PCACHE_BPP; k++) {
+                if (pg->io[k].blockno == 0)
+                    continue;
+                struct fsbuf *bp = fsbuf_overwrite(pg->io[k].dev, pg->io[k].blockno);
+                memmove(bp->data, pg->io[k].data, BSIZE);
+                fslog_write(bp);
+                fsbuf_release(bp);
+                room--;
+            }
+            pcache_flags(pg, 0, PG_DIRTY);
+        } else {
+            pcache_write_start(pg);
+        }
+    }
+
+    pg = pcache.txnq;
+    pcache.txnq = 0;
+    while (pg) {
+        struct pcpage *next = pg->nnext;
+        pcache_settle(pg);
+        pg->nnext = 0;
+        pcache_flags(pg, 0, PG_TXN);
+        pcache_put(pg);
+        pg = next;
+    }
+}
+
+// 把最多 PCACHE_SCAN 个脏页从 LRU 尾部（最久没碰的）开始写回，返回写了几页
+static int pcache_flush(void) {
+    struct pcpage *pgs[PCACHE_SCAN];
+    int n = 0;
+    for (struct pcpage *pg = pcache.lru.prev; pg != &pcache.lru && n < PCACHE_SCAN; pg = pg->prev) {
+        if ((pg->flags & (PG_DIRTY | PG_IO | PG_TXN)) == PG_DIRTY)
+            pgs[n++] = pg;
+    }
+    pcache_write_batch(pgs, n);
+    return n;
+}
+
+// pflush 内核线程：每 PCACHE_FLUSH_TICKS 个时钟中断醒一次，把这时候的脏页写回
+void pcache_flusher(void) {
+    for (;;) {
+        uint start = ticks;
+        while (ticks - start < PCACHE_FLUSH_TICKS)
+            sleep((void *) &ticks);
+        // 写回期间又变脏的页留到下一轮，不然一直有进程在写就停不下来
+        uint todo = pcache.ndirty;
+        while (todo > 0) {
+            int n = pcache_flush();
+            if (n == 0)
+                break;
+            todo = todo > (uint) n ? todo - n : 0;
+        }
+    }
+}
+
+// 缓存了几页、其中几页是脏的
+void pcache_stat(uint64 *cached, uint64 *dirty) {
+    *cached = pcache.n;
+    *dirty = pcache.ndirty;
+}
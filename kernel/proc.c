@@ -92,8 +92,10 @@ void proc_free_pagetable(pagetable_t pagetable, uint64 size) {
         // vmem_unmap_pagetable 会处理那些未映射的 va (返回-1)，所以我们不用检查
         vmem_unmap_pagetable(pagetable, va, 1);
     }
-    // 释放栈区，目前只有一页
-    vmem_unmap_pagetable(pagetable,USER_STACK_VA, 1);
+    // 释放栈区，栈从 MAX_USER_VA 往下连续映射
+    for (va = vmem_stack_base(pagetable); va < MAX_USER_VA; va += PAGE_SIZE) {
+        vmem_unmap_pagetable(pagetable, va, 1);
+    }
 
     // 3. 释放页表目录页 (非叶子)
     //    因为所有叶子都已被解除，这个函数不会 panic
@@ -101,6 +103,8 @@ void proc_free_pagetable(pagetable_t pagetable, uint64 size) {
 }
 
 void proc_free(struct proc *p) {
+    // 正常退出的进程在 exit 里已经解除了映射，这里收拾 fork 到一半失败的
+    vma_unmap_all(p);
     if (p->trapframe) {
         kmem_free(p->trapframe);
     }
@@ -165,6 +169,7 @@ struct proc *proc_alloc(void) {
     // 找到了
     p->pid = proc_allocpid();
     p->state = USED;
+    p->ilocks = 0;
     // 分配trapframe
     p->trapframe = kmem_alloc();
     if (p->trapframe == 0) {
@@ -201,17 +206,24 @@ uint64 proc_fork() {
     if (vmem_user_copy(p->pagetable, new_p->pagetable, p->size) < 0) {
         proc_free(new_p);
         return -1; // 复制失败
-    } // 复制栈区
+    }
+    // 马上记下大小：后面复制栈或 mmap 失败时，proc_free 要靠它释放已经复制的用户页
+    new_p->size = p->size;
+    // 复制栈区
     if (vmem_stack_copy(p->pagetable, new_p->pagetable) < 0) {
         proc_free(new_p);
         return -1;
     }
+    // 复制 mmap 的映射
+    if (vma_fork(p, new_p) < 0) {
+        proc_free(new_p);
+        return -1;
+    }
     // 复制陷阱帧
     memmove(new_p->trapframe, p->trapframe, sizeof(struct trapframe));
     // 设置子进程返回值
     new_p->trapframe->a0 = 0;
     new_p->parent = p;
-    new_p->size = p->size;
     new_p->state = RUNNABLE;
 
     // 复制打开的文件
@@ -232,36 +244,17 @@ uint64 proc_fork() {
 }
 
 
-// 创建一个内核进程，直接传入一个函数用于执行
-// struct proc *kproc_create(void (*proc_func)()) {
-//     struct proc *p = proc_alloc();
-//     // 没找到
-//     if (p == 0) {
-//         return 0;
-//     }
-//     // 找到了
-//     void *kstack_pa = kmem_alloc(); // 分配内核栈
-//     void *ktrapframe_pa = kmem_alloc(); //  分配内核陷阱帧
-//     if (kstack_pa == 0) {
-//         // 栈分配失败
-//         p->state = UNUSED;
-//         return 0;
-//     }
-//     if (ktrapframe_pa == 0) {
-//         // 陷阱帧分配失败
-//         p->state = UNUSED;
-//         kmem_free(kstack_pa);
-//         return 0;
-//     }
-//     uint64 kstack_top_pa = (uint64) kstack_pa + PAGE_SIZE; // 设置栈顶
-//     // 清理垃圾数据
-//     memset(&p->context, 0, sizeof(p->context));
-//     // 设置context返回地址和栈，陷阱帧
-//     p->context.sp = kstack_top_pa;
-//     p->trapframe = ktrapframe_pa;
-//     p->state = RUNNABLE;
-//     return p;
-// }
+// 创建一个内核线程，直接传入一个函数用于执行
+// 不回用户态：第一次被调度时从 proc_func 开始，在自己的内核栈上一直跑，proc_func 不能返回
+// 中断一直关着，只在 sleep 里让出 CPU
+struct proc *kproc_create(void (*proc_func)()) {
+    struct proc *p = proc_alloc();
+    if (p == 0)
+        return 0;
+    p->context.ra = (uint64) proc_func;
+    p->state = RUNNABLE;
+    return p;
+}
 
 // 问题：
 // 如果应用首次被调度器选中（就是main函数初始化完毕，调用schedule），
@@ -362,6 +355,8 @@ void exit(int status) {
     if (p == initproc) {
         panic("initproc exit");
     }
+    // 共享映射写过的页要写回文件，趁进程还能睡眠时解除映射
+    vma_unmap_all(p);
     // 关中断
     intr_off();
     p->state = ZOMBIE;
@@ -443,9 +438,9 @@ int proc_grow(int size) {
     struct proc *p = proc_running();
     uint64 new_size = p->size + size;
     if (size > 0) {
-        // 增长堆
-        if (new_size >= USER_STACK_VA) {
-            return -1; // 堆栈碰撞
+        // 增长堆，不能碰到 mmap 的区域（和它之间至少空一页）
+        if (PAGE_UP(new_size) + PAGE_SIZE > vma_lowest(p)) {
+            return -1; // 堆和映射碰撞
         }
         if (vmem_user_alloc(p->pagetable, p->size, new_size) < 0) {
             return -1; // 分配/映射失败
@@ -0,0 +1,67 @@
+#include "../include/shm.h"
+#include "../include/kalloc.h"
+#include "../include/string.h"
+
+// 共享内存段，和信号量一样是全局的一张表
+// 段里的物理页在第一次被访问时才分配，之后所有映射这段的进程都映射这一页
+struct shmseg shms[MAX_SHMS];
+
+// 按 key 找段，没有就新建一段 size 字节的；key 为 0 总是新建一个匿名段
+// 已有的段比 size 小，或者表满了返回 0；成功时引用计数 +1
+struct shmseg *shm_get(int key, uint64 size) {
+    uint64 npages = PAGE_UP(size) / PAGE_SIZE;
+    if (npages == 0 || npages > SHM_MAXPAGES)
+        return 0;
+
+    struct shmseg *s, *free = 0;
+    for (s = shms; s < shms + MAX_SHMS; s++) {
+        if (s->ref == 0) {
+            if (free == 0)
+                free = s;
+        } else if (key != 0 && s->key == key) {
+            if (npages > s->npages)
+                return 0;
+            s->ref++;
+            return s;
+        }
+    }
+    if (free == 0)
+        return 0;
+    free->pages = kmem_try_alloc();
+    if (free->pages == 0)
+        return 0;
+    memset(free->pages, 0, PAGE_SIZE);
+    free->key = key;
+    free->npages = npages;
+    free->ref = 1;
+    return free;
+}
+
+void shm_dup(struct shmseg *s) {
+    s->ref++;
+}
+
+// 放掉一个引用，最后一个引用放掉时释放所有物理页
+void shm_put(struct shmseg *s) {
+    if (--s->ref > 0)
+        return;
+    for (uint i = 0; i < s->npages; i++) {
+        if (s->pages[i])
+            kmem_free(s->pages[i]);
+    }
+    kmem_free(s->pages);
+    s->pages = 0;
+    s->key = 0;
+}
+
+// 段里第 index 页的物理页，还没有就分配一页 0
+char *shm_page(struct shmseg *s, uint index) {
+    if (s->pages[index] == 0) {
+        char *pa = kmem_try_alloc();
+        if (pa == 0)
+            return 0;
+        memset(pa, 0, PAGE_SIZE);
+        s->pages[index] = pa;
+    }
+    return s->pages[index];
+}
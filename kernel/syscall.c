@@ -7,6 +7,7 @@
 #include "../include/memlayout.h"
 #include "../include/param.h"
 #include "../include/sem.h"
+#include "../include/shm.h"
 #include "../include/string.h"
 #include "../include/vm.h"
 
@@ -38,7 +39,12 @@ static uint64 (*syscalls[])(void) = {
     [SYSCALL_link] = syscall_link,
     [SYSCALL_unlink] = syscall_unlink,
     [SYSCALL_sleep] = syscall_sleep,
-    [SYSCALL_uptime] = syscall_uptime
+    [SYSCALL_uptime] = syscall_uptime,
+    [SYSCALL_diskstat] = syscall_diskstat,
+    [SYSCALL_diskpoll] = syscall_diskpoll,
+    [SYSCALL_mmap] = syscall_mmap,
+    [SYSCALL_munmap] = syscall_munmap,
+    [SYSCALL_shm_open] = syscall_shm_open
 };
 
 void syscall(void) {
@@ -274,6 +280,23 @@ uint64 syscall_sem_signal(void) {
     return sem_signal_id(sem_id);
 }
 
+// shm_open(key, size)：按 key 打开一段共享内存，没有就新建 size 字节的，可读写地映射进来
+// 返回起始地址，失败返回 -1；用 munmap 解除，所有映射都解除后段连同物理页一起释放
+uint64 syscall_shm_open(void) {
+    int key;
+    uint64 size;
+    if (argint(0, &key) < 0 || argaddr(1, &size) < 0)
+        return -1;
+    if (key == 0) // 0 留给匿名段
+        return -1;
+    struct shmseg *s = shm_get(key, size);
+    if (s == 0)
+        return -1;
+    uint64 addr = vma_mmap(proc_running(), size, PROT_READ | PROT_WRITE, MAP_SHARED, 0, s, 0);
+    shm_put(s);
+    return addr;
+}
+
 uint64 syscall_sbrk(void) {
     int size;
     argint(0, &size);
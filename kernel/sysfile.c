@@ -1,9 +1,12 @@
 #include "../include/fs.h"
 #include "../include/sysinfo.h"
+#include "../include/kalloc.h"
+#include "../include/memlayout.h"
 #include "../include/param.h"
 #include "../include/pipe.h"
 #include "../include/printf.h"
 #include "../include/proc.h"
+#include "../include/shm.h"
 #include "../include/string.h"
 #include "../include/syscall.h"
 #include "../include/vm.h"
@@ -68,8 +71,8 @@ static struct inode *create(char *path, short type, short major, short minor) {
         return 0; // 类型冲突 (比如原本是个目录)
     }
 
-    // 3. 分配新 inode
-    if ((ip = fs_inode_alloc(dp->dev, type)) == 0) {
+    // 3. 分配新 inode：普通文件放在父目录附近；新目录从 rotor 开始，把目录分散开
+    if ((ip = fs_inode_alloc_near(dp->dev, type, type == T_DIR ? 0 : dp->inum)) == 0) {
         panic("create: ialloc");
         return 0;
     }
@@ -363,23 +366,10 @@ out:
     return ret;
 }
 
-static int dir_is_empty(struct inode *ip) {
-    struct dirent de;
-    for (int off = 2 * sizeof(de); off < ip->size; off += sizeof(de)) {
-        if (fs_inode_read_data(ip, 0, (char *) &de, off, sizeof(de)) != sizeof(de))
-            panic("dir_is_empty: read");
-        if (de.inum != 0) {
-            return 0;
-        }
-    }
-    return 1;
-}
-
 uint64 syscall_unlink(void) {
     char path[MAXPATH];
     char name[DIRSIZ];
     struct inode *dp = 0, *ip = 0;
-    struct dirent de;
     uint off;
     int ret = -1;
 
@@ -408,12 +398,10 @@ uint64 syscall_unlink(void) {
     if (ip->nlink < 1)
         panic("syscall_unlink: nlink < 1");
 
-    if (ip->type == T_DIR && !dir_is_empty(ip))
+    if (ip->type == T_DIR && !fs_dir_is_empty(ip))
         goto bad;
 
-    memset(&de, 0, sizeof(de));
-    if (fs_inode_write_data(dp, 0, (char *) &de, off, sizeof(de)) != sizeof(de))
-        panic("syscall_unlink: write");
+    fs_dir_unlink(dp, name, off);
 
     if (ip->type == T_DIR) {
         dp->nlink--;
@@ -488,6 +476,9 @@ uint64 syscall_sysinfo(void) {
     // 目前只支持主设备 ROOTDEV (1)
     // 未来可以扩展为支持传入 path 来查看特定挂载点
     fs_get_info(ROOTDEV, &info.total_blocks, &info.free_blocks, &info.total_inodes, &info.free_inodes);
+    info.block_size = BSIZE;
+    pcache_stat(&info.cached_pages, &info.dirty_pages);
+    info.free_pages = kmem_free_pages();
 
     struct proc *p = proc_running();
     if (vmem_copyout(p->pagetable, addr, (char *) &info, sizeof(info)) < 0)
@@ -496,6 +487,32 @@ uint64 syscall_sysinfo(void) {
     return 0;
 }
 
+// 磁盘驱动统计：通知次数、中断次数等
+uint64 syscall_diskstat(void) {
+    struct diskstat st;
+    uint64 addr;
+
+    if (argaddr(0, &addr) < 0)
+        return -1;
+
+    virtio_disk_stat(&st);
+    iosched_stat(&st);
+
+    struct proc *p = proc_running();
+    if (vmem_copyout(p->pagetable, addr, (char *) &st, sizeof(st)) < 0)
+        return -1;
+
+    return 0;
+}
+
+// 设置磁盘请求的全局等待方式，返回原来的方式
+uint64 syscall_diskpoll(void) {
+    int mode;
+    if (argint(0, &mode) < 0)
+        return -1;
+    return virtio_disk_set_poll(mode);
+}
+
 uint64 syscall_pipe(void) {
     uint64 fdarray; // 用户传入的数组指针 int fd[2]
     struct file *rf, *wf;
@@ -532,3 +549,61 @@ uint64 syscall_pipe(void) {
 
     return 0;
 }
+
+// mmap(addr, len, prot, flags, fd, off)：addr 只是提示，目前忽略，映射放在哪由内核决定
+// 文件映射要求 off 页对齐；共享的匿名映射是一个没有 key 的共享内存段
+// 成功返回映射的起始地址，失败返回 -1
+uint64 syscall_mmap(void) {
+    uint64 len, off;
+    int prot, flags;
+    struct file *f;
+    struct inode *ip = 0;
+
+    if (argaddr(1, &len) < 0 || argint(2, &prot) < 0 || argint(3, &flags) < 0 || argaddr(5, &off) < 0)
+        return -1;
+    if (len == 0 || len > USER_MMAP_TOP || off % PAGE_SIZE != 0)
+        return -1;
+    // 共享和私有必须二选一
+    if (((flags & MAP_SHARED) != 0) == ((flags & MAP_PRIVATE) != 0))
+        return -1;
+    // RISC-V 的页不能只写不读
+    if (prot & PROT_WRITE)
+        prot |= PROT_READ;
+
+    if (flags & MAP_ANONYMOUS) {
+        if (flags & MAP_SHARED) {
+            // fork 出来的子进程继承映射，和父进程用同一批页
+            struct shmseg *s = shm_get(0, len);
+            if (s == 0)
+                return -1;
+            uint64 addr = vma_mmap(proc_running(), len, prot, flags, 0, s, 0);
+            shm_put(s);
+            return addr;
+        }
+    } else {
+        if (argfd(4, 0, &f) < 0 || f->type != FD_INODE || f->ip->type != T_FILE || !f->readable)
+            return -1;
+        if ((flags & MAP_SHARED) && (prot & PROT_WRITE) && !f->writable)
+            return -1;
+        ip = f->ip;
+        // 内联的小文件内容在 inode 里，页缓存看不到，先转成块映射
+        // 映射占着 inode 的引用，文件不会被截断，也就不会再变回内联
+        if (ip->flags & I_INLINE) {
+            fslog_op_begin();
+            fs_inode_lock(ip);
+            if (ip->flags & I_INLINE)
+                fs_inline_to_blocks(ip);
+            fs_inode_unlock(ip);
+            fslog_op_end();
+        }
+    }
+    return vma_mmap(proc_running(), len, prot, flags, ip, 0, off);
+}
+
+// munmap(addr, len)：addr 要页对齐，范围里没有映射的部分跳过
+uint64 syscall_munmap(void) {
+    uint64 addr, len;
+    if (argaddr(0, &addr) < 0 || argaddr(1, &len) < 0)
+        return -1;
+    return vma_munmap(proc_running(), addr, len);
+}
@@ -108,12 +108,15 @@ uint64 trap_user() {
             // 必须手动让它指向下一条指令。
             p->trapframe->epc += 4;
             syscall();
-        } else if (scause == 13 || scause == 15) {
-            // TODO: 正确处理用户异常而不是panic
-            // 13/15 代表 Load/Store/AMO page fault (页面错误)
-            printf("trap_user: scause: %p, sepc: %p\n", (void *) scause, (void *) sepc);
-            panic("user tried to write/load to a invalid page.");
-            // p->trapframe->epc += 4;
+        } else if (scause == 12 || scause == 13 || scause == 15) {
+            // 12/13/15 代表 取指/Load/Store/AMO page fault (页面错误)
+            // mmap 区域和栈区里的页在这里按需映射，别的地址（包括栈长过上限）是用户程序的错，杀掉进程
+            int access = scause == 12 ? PROT_EXEC : scause == 13 ? PROT_READ : PROT_WRITE;
+            uint64 va = r_stval();
+            if (vma_fault(p, va, access) < 0) {
+                printf("trap_user: pid %d bad access %p, scause: %p, sepc: %p\n", p->pid, (void *) va, (void *) scause, (void *) sepc);
+                exit(-1);
+            }
         } else {
             // 其他异常，比如访问了非法内存
             printf("trap_user: unexpected scause %p, sepc %p\n", (void *) scause, (void *) sepc);
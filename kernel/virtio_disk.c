@@ -5,27 +5,56 @@
 #include "../include/proc.h"
 #include "../include/riscv.h"
 #include "../include/string.h"
+#include "../include/sysinfo.h"
 #include "../include/types.h"
 #include "../include/virtio.h" // VIRTIO_MMIO_BASE 等宏定义
 
 int DEBUG = 0;
 
-#define R(r) ((volatile uint32 *)(VIRTIO0 + (r)))
+// 全局等待方式，DISK_WAIT_INTR 或 DISK_WAIT_POLL
+// 默认睡眠等中断：单 CPU 上轮询时别的进程都跑不了，要用的话由 iostat -p 1 或单个请求自己打开
+int virtio_disk_poll_mode = DISK_WAIT_INTR;
+
+// 轮询时长 = 轮询收割到的请求平均延迟的两倍，限制在这个范围内（time CSR 计数，qemu 上 10MHz）
+#define POLL_BUDGET_MIN 500
+#define POLL_BUDGET_MAX 20000
 
-struct fsbuf *current_disk_buf;
+#define R(r) ((volatile uint32 *)(VIRTIO0 + (r)))
 
-// 驱动本身的状态，虽然有NUM个但是现在只用一个
+// 驱动本身的状态，NUM 个描述符可以同时挂多个请求
 static struct {
     struct virtq_desc *desc; // 描述符表
     struct virtq_avail *avail; // 请求队列
     struct virtq_used *used; // 完成队列
 
-    // 记录当前正在进行的请求状态（VIRTIO协议要求分三段）
-    struct virtio_blk_req req;
+    char free[NUM]; // 描述符是否空闲
+    uint16 used_idx; // 已经处理到 used ring 的哪个位置
+    uint16 kicked_idx; // 上次通知设备时 avail->idx 的值
+
+    int indirect; // 协商到了 VIRTIO_RING_F_INDIRECT_DESC
+    int event_idx; // 协商到了 VIRTIO_RING_F_EVENT_IDX
+    // 间接描述符表，用请求头描述符编号索引，每张表放得下一个最长的请求
+    struct virtq_desc *indirect_tbl[NUM];
+
+    // 每个请求的记录，用请求头描述符的编号索引
+    struct {
+        struct fsbuf *bufs[VIRTIO_MAXSEG]; // 这个请求覆盖的 buffer，完成时逐个唤醒
+        int n;
+        uint64 start; // 提交时间，用来统计延迟
+        uint8 status; // 设备写回的结果（成功/失败）
+    } info[NUM];
+
+    uint64 lat_avg; // 轮询收割到的请求延迟的滑动平均，决定轮询多久
 
-    uint8 status; // 磁盘操作结果（成功/失败）
+    // 每个请求的请求头（VIRTIO协议要求分三段），同样用头描述符编号索引
+    struct virtio_blk_req ops[NUM];
+
+    struct diskstat stat;
 } disk;
 
+// 一张间接表的描述符个数：头 + 数据 + 状态
+#define INDIRECT_LEN (VIRTIO_MAXSEG + 2)
+
 void virtio_disk_init(void) {
     // 依次检查：
     // MAGIC_VALUE 是否为 'virt'（0x74726976）
@@ -64,8 +93,10 @@ void virtio_disk_init(void) {
     features &= ~(1 << VIRTIO_BLK_F_CONFIG_WCE);
     features &= ~(1 << VIRTIO_BLK_F_MQ);
     features &= ~(1 << VIRTIO_F_ANY_LAYOUT);
-    features &= ~(1 << VIRTIO_RING_F_EVENT_IDX);
-    features &= ~(1 << VIRTIO_RING_F_INDIRECT_DESC);
+    // 间接描述符和 EVENT_IDX 设备支持就用：前者让一个请求只占一个 ring 槽位，
+    // 后者让驱动和设备都能跳过对方不需要的通知/中断
+    disk.indirect = (features & (1 << VIRTIO_RING_F_INDIRECT_DESC)) != 0;
+    disk.event_idx = (features & (1 << VIRTIO_RING_F_EVENT_IDX)) != 0;
     // 把“我认可/选择使用的 feature 集”写回设备。
     *R(VIRTIO_MMIO_DRIVER_FEATURES) = features;
 
@@ -106,6 +137,31 @@ void virtio_disk_init(void) {
     memset(disk.avail, 0, PAGE_SIZE);
     memset(disk.used, 0, PAGE_SIZE);
 
+    // 间接表：一页切成几张，够 NUM 个请求同时在飞
+    if (disk.indirect) {
+        int per_page = PAGE_SIZE / (INDIRECT_LEN * sizeof(struct virtq_desc));
+        struct virtq_desc *page = 0;
+        for (int i = 0; i < NUM; i++) {
+            if (i % per_page == 0) {
+                page = kmem_alloc();
+                if (!page)
+                    panic("virtio disk kalloc");
+                memset(page, 0, PAGE_SIZE);
+            }
+            disk.indirect_tbl[i] = page + (i % per_page) * INDIRECT_LEN;
+        }
+    }
+
+    // 所有描述符一开始都空闲
+    for (int i = 0; i < NUM; i++)
+        disk.free[i] = 1;
+    disk.used_idx = 0;
+    disk.kicked_idx = 0;
+    memset(&disk.stat, 0, sizeof(disk.stat));
+    disk.lat_avg = POLL_BUDGET_MIN;
+    disk.stat.indirect = disk.indirect;
+    disk.stat.event_idx = disk.event_idx;
+
     // 告诉磁盘操作的物理地址
     *R(VIRTIO_MMIO_QUEUE_DESC_LOW) = (uint64) disk.desc;
     *R(VIRTIO_MMIO_QUEUE_DESC_HIGH) = (uint64) disk.desc >> 32;
@@ -124,97 +180,329 @@ void virtio_disk_init(void) {
     status |= VIRTIO_CONFIG_S_DRIVER_OK;
     *R(VIRTIO_MMIO_STATUS) = status;
 
-    printf("virtio_disk_init: initialized.\n");
+    printf("virtio_disk_init: initialized (indirect %d, event_idx %d).\n", disk.indirect, disk.event_idx);
 }
 
-// 核心函数：读写磁盘
-// b->dev, b->blockno, b->data 已经准备好了
-void virtio_disk_rw(struct fsbuf *b, int write) {
-    uint64 sector = b->blockno * (BSIZE / 512); // xv6块转扇区号
-
-    // --- 步骤 1: 填充 3 个描述符 (Descriptor) ---
-    // VIRTIO 规定一个磁盘请求必须包含三个部分链在一起：
-    // Desc[0]: 请求头 (Header) -> 告诉磁盘我要读/写哪个扇区
-    // Desc[1]: 数据 (Data)     -> 真正的数据存放地址
-    // Desc[2]: 状态 (Status)   -> 磁盘写回在这里，告诉我成功没
-
-    // 1.1 填充头 (Desc[0])
-    disk.req.type = write ? VIRTIO_BLK_T_OUT : VIRTIO_BLK_T_IN;
-    disk.req.sector = sector;
-
-    disk.desc[0].addr = (uint64) &disk.req; // 物理地址
-    disk.desc[0].len = sizeof(disk.req);
-    disk.desc[0].flags = VRING_DESC_F_NEXT; // 还有下文
-    disk.desc[0].next = 1; // 下一个是 Desc[1]
-
-    // 1.2 填充数据 (Desc[1])
-    disk.desc[1].addr = (uint64) b->data; // 缓冲区的数据地址
-    disk.desc[1].len = BSIZE;
-    if (write) {
-        disk.desc[1].flags = VRING_DESC_F_NEXT; // 如果是写，设备只是读这块内存
+// 分配一个空闲描述符，没有就返回 -1
+static int alloc_desc() {
+    for (int i = 0; i < NUM; i++) {
+        if (disk.free[i]) {
+            disk.free[i] = 0;
+            return i;
+        }
+    }
+    return -1;
+}
+
+// 归还一个描述符，并唤醒等描述符的进程
+static void free_desc(int i) {
+    if (i >= NUM)
+        panic("virtio_disk: free_desc index");
+    if (disk.free[i])
+        panic("virtio_disk: free_desc twice");
+    disk.desc[i].addr = 0;
+    disk.desc[i].len = 0;
+    disk.desc[i].flags = 0;
+    disk.desc[i].next = 0;
+    disk.free[i] = 1;
+    wakeup(&disk.free[0]);
+}
+
+// 沿着 next 归还一整条描述符链
+static void free_chain(int i) {
+    for (;;) {
+        int flag = disk.desc[i].flags;
+        int nxt = disk.desc[i].next;
+        free_desc(i);
+        if (flag & VRING_DESC_F_NEXT)
+            i = nxt;
+        else
+            break;
+    }
+}
+
+// 一次拿 n 个描述符，要么全拿到要么一个都不拿
+static int alloc_descs(int *idx, int n) {
+    for (int i = 0; i < n; i++) {
+        idx[i] = alloc_desc();
+        if (idx[i] < 0) {
+            for (int j = 0; j < i; j++)
+                free_desc(idx[j]);
+            return -1;
+        }
+    }
+    return 0;
+}
+
+// 处理 used ring 里所有已经完成的请求：
+// 通过头描述符编号找回 fsbuf，清除 disk 标记并唤醒等它的进程，归还描述符
+// polled 非 0 表示是轮询时收割的，只有这些请求的延迟计入平均：
+// 走中断的延迟包含了中断和调度的开销，算进来会把轮询时长越推越长
+static void virtio_disk_complete(int polled) {
+    __sync_synchronize();
+    while (disk.used_idx != ((volatile struct virtq_used *) disk.used)->idx) {
+        __sync_synchronize();
+        int id = disk.used->ring[disk.used_idx % NUM].id;
+
+        if (disk.info[id].status != 0)
+            panic("virtio_disk_complete: status");
+
+        if (polled) {
+            uint64 lat = r_time() - disk.info[id].start;
+            disk.lat_avg = (disk.lat_avg * 7 + lat) / 8;
+        }
+
+        for (int i = 0; i < disk.info[id].n; i++) {
+            struct fsbuf *b = disk.info[id].bufs[i];
+            disk.info[id].bufs[i] = 0;
+            b->disk = 0; // 先修改状态，确保唤醒看到的是任务已完成
+            wakeup(b);
+        }
+        disk.info[id].n = 0;
+        free_chain(id);
+
+        disk.used_idx += 1;
+    }
+
+    // 设备空出了位置，让调度器把排队的请求发下去
+    iosched_dispatch();
+
+    // 告诉设备：下一个请求完成时再来中断
+    // 设备在这之前完成的多个请求会合并成一次中断
+    if (disk.event_idx) {
+        disk.avail->used_event = disk.used_idx;
+        __sync_synchronize();
+    }
+}
+
+// 把 kicked_idx 之后挂上 avail ring 的请求通知给设备
+// 开了 EVENT_IDX 时，设备还在处理、没要求通知的话就不写寄存器
+static void virtio_disk_kick() {
+    uint16 old = disk.kicked_idx;
+    uint16 new = disk.avail->idx;
+    if (old == new)
+        return;
+    disk.kicked_idx = new;
+
+    __sync_synchronize(); // 先让 avail->idx 对设备可见，再读它的 avail_event
+
+    if (disk.event_idx &&
+        !vring_need_event(((volatile struct virtq_used *) disk.used)->avail_event, new, old)) {
+        disk.stat.notify_skips++;
+        return;
+    }
+    disk.stat.notifies++;
+    *R(VIRTIO_MMIO_QUEUE_NOTIFY) = 0; // 0号队列有新消息！
+}
+
+// 为请求 head 填好链条：头、n 段数据、状态，d 是存放这条链的描述符数组，
+// idx[i] 是第 i 个描述符在 d 里的下标
+static void fill_chain(struct virtq_desc *d, int *idx, int head, struct fsbuf **bufs, int n, int write) {
+    // 头
+    d[idx[0]].addr = (uint64) &disk.ops[head]; // 物理地址
+    d[idx[0]].len = sizeof(struct virtio_blk_req);
+    d[idx[0]].flags = VRING_DESC_F_NEXT; // 还有下文
+    d[idx[0]].next = idx[1];
+
+    // 数据，每个 buffer 一段
+    for (int i = 0; i < n; i++) {
+        struct virtq_desc *e = &d[idx[i + 1]];
+        e->addr = (uint64) bufs[i]->data; // 缓冲区的数据地址
+        e->len = BSIZE;
+        if (write) {
+            e->flags = VRING_DESC_F_NEXT; // 如果是写，设备只是读这块内存
+        } else {
+            e->flags = VRING_DESC_F_NEXT | VRING_DESC_F_WRITE; // 如果是读，设备要写这块内存
+        }
+        e->next = idx[i + 2];
+    }
+
+    // 状态，设备成功时会写 0
+    disk.info[head].status = 0xff;
+    d[idx[n + 1]].addr = (uint64) &disk.info[head].status;
+    d[idx[n + 1]].len = 1;
+    d[idx[n + 1]].flags = VRING_DESC_F_WRITE; // 设备会写这里
+    d[idx[n + 1]].next = 0; // 链条结束
+}
+
+// 把 n 个 buffer 作为一个请求挂到 avail ring 上：从 blockno 开始的连续 n 个块，
+// 第 i 个 buffer 对应 blockno + i，n 不超过 VIRTIO_MAXSEG（没有间接表时不超过 VIRTIO_DIRECT_MAXSEG）
+// 只挂不通知，由调用者在一批请求挂完后 virtio_disk_kick
+static void virtio_disk_submit_one(uint blockno, struct fsbuf **bufs, int n, int write) {
+    // --- 步骤 1: 拿描述符 ---
+    // VIRTIO 规定一个磁盘请求由三部分链在一起：
+    // idx[0]:     请求头 (Header) -> 告诉磁盘我要读/写哪个扇区
+    // idx[1..n]:  数据 (Data)     -> 每个 buffer 一个描述符，设备按顺序填满连续的扇区
+    // idx[n + 1]: 状态 (Status)   -> 磁盘写回在这里，告诉我成功没
+    // 有间接表时整条链放在表里，ring 上只占一个描述符
+    int idx[INDIRECT_LEN];
+    int need = disk.indirect ? 1 : n + 2;
+    while (alloc_descs(idx, need) != 0) {
+        // 前面挂上去还没通知的请求要先让设备看到，否则永远等不到描述符
+        virtio_disk_kick();
+        if (proc_running() == 0) {
+            // 启动阶段没有进程可以睡，直接收割已完成的请求腾出描述符
+            virtio_disk_complete(0);
+        } else {
+            sleep(&disk.free[0]);
+        }
+    }
+    int head = idx[0];
+
+    struct virtio_blk_req *req = &disk.ops[head];
+    req->type = write ? VIRTIO_BLK_T_OUT : VIRTIO_BLK_T_IN;
+    req->reserved = 0;
+    req->sector = (uint64) blockno * (BSIZE / 512); // xv6块转扇区号
+
+    if (disk.indirect) {
+        struct virtq_desc *tbl = disk.indirect_tbl[head];
+        for (int i = 0; i < n + 2; i++)
+            idx[i] = i;
+        fill_chain(tbl, idx, head, bufs, n, write);
+        disk.desc[head].addr = (uint64) tbl;
+        disk.desc[head].len = (n + 2) * sizeof(struct virtq_desc);
+        disk.desc[head].flags = VRING_DESC_F_INDIRECT;
+        disk.desc[head].next = 0;
     } else {
-        disk.desc[1].flags = VRING_DESC_F_NEXT | VRING_DESC_F_WRITE; // 如果是读，设备要写这块内存
+        fill_chain(disk.desc, idx, head, bufs, n, write);
     }
-    disk.desc[1].next = 2; // 下一个是 Desc[2]
 
-    // 1.3 填充状态 (Desc[2])
-    disk.desc[2].addr = (uint64) &disk.status;
-    disk.desc[2].len = 1;
-    disk.desc[2].flags = VRING_DESC_F_WRITE; // 设备会写这里
-    disk.desc[2].next = 0; // 链条结束
+    // 记下这个请求覆盖哪些 buf，在中断里通过头描述符找回
+    for (int i = 0; i < n; i++) {
+        bufs[i]->disk = 1; // 1 表示提交给磁盘了，任务还没完成
+        disk.info[head].bufs[i] = bufs[i];
+    }
+    disk.info[head].n = n;
+    disk.info[head].start = r_time();
+    disk.stat.requests++;
+    disk.stat.blocks += n;
 
     // --- 步骤 2: 把任务加入 "Available Ring" ---
-
-    // 告诉设备：这一串描述符的头是 Desc[0]
-    disk.avail->ring[disk.avail->idx % 8] = 0;
+    disk.avail->ring[disk.avail->idx % NUM] = head;
 
     __sync_synchronize(); // 内存屏障：确保上面数据都写好了再更新 idx
 
     disk.avail->idx += 1; // 任务数 +1
+}
 
-    current_disk_buf = b; // 保存当前正在处理的 buf，在中断里找回
+// 一个请求最多带多少块
+int virtio_disk_maxseg() {
+    return disk.indirect ? VIRTIO_MAXSEG : VIRTIO_DIRECT_MAXSEG;
+}
 
-    __sync_synchronize();
+// 现在能不能不等待地提交一个 n 块的请求（描述符够不够）
+int virtio_disk_can_submit(int n) {
+    int need = disk.indirect ? 1 : n + 2;
+    for (int i = 0; i < NUM && need > 0; i++) {
+        if (disk.free[i])
+            need--;
+    }
+    return need == 0;
+}
 
-    // --- 步骤 3: 敲门通知设备 (Notify) ---
-    b->disk = 1; // 1 表示提交给磁盘了，任务还没完成
+// 已经交给设备、还没收割的请求数
+int virtio_disk_inflight() {
+    return (uint16) (disk.avail->idx - disk.used_idx);
+}
 
-    *R(VIRTIO_MMIO_QUEUE_NOTIFY) = 0; // 0号队列有新消息！
+// 提交一个读写请求，不等待完成
+// 完成后 virtio_disk_complete 会把 b->disk 清 0 并 wakeup(b)
+void virtio_disk_submit(struct fsbuf *b, int write) {
+    virtio_disk_submit_one(b->blockno, &b, 1, write);
+    virtio_disk_kick();
+}
 
-    // --- 步骤 4: 死循环等待 (Busy Wait) ---
-    // 真实 OS 会在这里 sleep(b)，然后中断里 wakeup
-    // 咱们简化版就在这死等，直到 Used Ring 的 idx 追上 Avail Ring
-
-    // 极其简化的判断：一直在轮询 used->idx 是否变化
-    // 实际代码需要记录之前的 used_idx 来对比
-    // 使用volatile 关键字，告诉编译器不要优化这段代码，
-    // 否则会被优化成从寄存器里面取值，永远不会变
-    // while (((volatile struct virtq_used *) disk.used)->idx != disk.avail->idx) {
-    //     // 傻等...
-    // }
+// 分散/聚集读写：bufs[i] 对应磁盘上第 blockno + i 块，
+// 整段连续扇区作为尽量少的请求提交，所有请求挂完只通知一次，不等待完成
+// 调用者对每个 buffer 调 virtio_disk_wait 等待
+void virtio_disk_submit_vec(uint blockno, struct fsbuf **bufs, int n, int write) {
+    int maxseg = virtio_disk_maxseg();
+    while (n > 0) {
+        int m = n < maxseg ? n : maxseg;
+        virtio_disk_submit_one(blockno, bufs, m, write);
+        blockno += m;
+        bufs += m;
+        n -= m;
+    }
+    virtio_disk_kick();
+}
+
+// 当前轮询时长上限
+static uint64 poll_budget() {
+    uint64 budget = disk.lat_avg * 2;
+    if (budget < POLL_BUDGET_MIN)
+        budget = POLL_BUDGET_MIN;
+    if (budget > POLL_BUDGET_MAX)
+        budget = POLL_BUDGET_MAX;
+    return budget;
+}
+
+// 在 used ring 上转一会儿，b 完成了返回 1，超时返回 0
+// 系统调用里中断是关着的，这里直接收割不会和中断处理撞上
+static int virtio_disk_poll(struct fsbuf *b) {
+    uint64 deadline = r_time() + poll_budget();
+    while (b->disk == 1 && r_time() < deadline) {
+        if (disk.used_idx != ((volatile struct virtq_used *) disk.used)->idx)
+            virtio_disk_complete(1);
+    }
+    if (b->disk == 1) {
+        // 没等到，说明设备这阵子比较慢，下次少转一会儿
+        disk.lat_avg /= 2;
+        disk.stat.poll_misses++;
+        return 0;
+    }
+    disk.stat.poll_hits++;
+    // 请求已经收割了，设备发来的中断不用再处理
+    // 先应答再收割一遍：应答之前刚完成的请求，它的中断也被一起应答掉了，不收割就丢了
+    *R(VIRTIO_MMIO_INTERRUPT_ACK) = *R(VIRTIO_MMIO_INTERRUPT_STATUS) & 0x3;
+    __sync_synchronize();
+    virtio_disk_complete(1);
+    return 1;
+}
+
+// 等待 b 上的请求完成，mode 是 DISK_WAIT_*
+void virtio_disk_wait_mode(struct fsbuf *b, int mode) {
+    if (mode == DISK_WAIT_DEFAULT)
+        mode = virtio_disk_poll_mode;
     if (proc_running() == 0) {
         // 启动阶段：没有进程，只能忙等待
-        while (((volatile struct virtq_used *) disk.used)->idx != disk.avail->idx) {
-            // 忙等待...
-        }
-        // --- 模拟中断处理 ---
         // 因为这时候 virtio_disk_intr 可能不会跑，我们需要手动做清理工作
+        while (b->disk == 1) {
+            virtio_disk_complete(0);
+        }
         *R(VIRTIO_MMIO_INTERRUPT_ACK) = *R(VIRTIO_MMIO_INTERRUPT_STATUS) & 0x3;
-        // 标记 buffer 完成
-        b->disk = 0;
-        b->valid = 1;
-    } else {
+        __sync_synchronize();
+        virtio_disk_complete(0);
+    } else if (b->disk == 1 && (mode != DISK_WAIT_POLL || !virtio_disk_poll(b))) {
         if (DEBUG)
             printf("RW: Start sleep...\n");
         while (b->disk == 1) {
-            sleep(b); // 核心改变：交出 CPU
+            sleep(b); // 交出 CPU，中断里完成后唤醒
         }
         if (DEBUG)
             printf("RW: Woke up!\n");
-        // --- 步骤 5: 收尾 ---
-        // b->disk = 0; // 清除脏标记（如果是写操作）
-        b->valid = 1; // 标记数据有效（如果是读操作）
     }
+    b->valid = 1; // 标记数据有效（如果是读操作）
+}
+
+// 等待 b 上的请求完成，按全局设置决定轮询还是睡眠
+void virtio_disk_wait(struct fsbuf *b) {
+    virtio_disk_wait_mode(b, DISK_WAIT_DEFAULT);
+}
+
+// 设置全局等待方式，返回原来的
+int virtio_disk_set_poll(int mode) {
+    int old = virtio_disk_poll_mode;
+    if (mode == DISK_WAIT_INTR || mode == DISK_WAIT_POLL)
+        virtio_disk_poll_mode = mode;
+    return old;
+}
+
+// 核心函数：读写磁盘
+// b->dev, b->blockno, b->data 已经准备好了
+void virtio_disk_rw(struct fsbuf *b, int write) {
+    virtio_disk_submit(b, write);
+    virtio_disk_wait(b);
 }
 
 void virtio_disk_intr() {
@@ -223,19 +511,17 @@ void virtio_disk_intr() {
         printf("IRQ: Disk interrupt!\n");
     *R(VIRTIO_MMIO_INTERRUPT_ACK) = *R(VIRTIO_MMIO_INTERRUPT_STATUS) & 0x3;
     __sync_synchronize();
-    // 获取完成的任务 ID (在极简驱动里，我们需要一种方式把 ID 映射回 fsbuf)
-    // 难点：我们需要知道这个完成的任务对应哪个 buf。
-    // xv6 的做法是：desc[0].addr 存的不只是地址，它把 buf 的索引作为 ID 传给磁盘。
-    // 既然我们现在是单进程串行排队（一次只提交一个），
-    // 那么完成的肯定就是当前正在睡觉的那个 buf
-    // 我们可以定义一个全局变量 struct fsbuf *current_disk_buf;
-    // TODO：可以遍历 fsbuf找到对应的buf
-    if (current_disk_buf) {
-        // 先修改状态，确保唤醒看到的是任务已完成
-        current_disk_buf->disk = 0;
-        wakeup(current_disk_buf);
-        current_disk_buf = 0;
-    }
+    disk.stat.interrupts++;
+    // 2. 处理所有完成的请求，可能一次完成了好几个
+    virtio_disk_complete(0);
+}
+
+
+// 拷贝一份驱动统计
+void virtio_disk_stat(struct diskstat *st) {
+    *st = disk.stat;
+    st->poll_mode = virtio_disk_poll_mode;
+    st->poll_budget = poll_budget();
 }
 
 
@@ -244,7 +530,8 @@ void virtio_disk_intr() {
 // 这是一个伪造的 buf，因为我们还没有 bio 层
 // 我们手动分配一块内存给它
 static struct fsbuf b;
-static uchar data_buffer[BSIZE]; // 1024字节
+static uchar data_buffer[BSIZE]; // 一块
+static uchar data_page[BSIZE]; // b 的数据区
 
 void virtio_disk_test(void) {
     printf("--- [TEST] Start VirtIO Disk Test ---\n");
@@ -255,6 +542,7 @@ void virtio_disk_test(void) {
     }
 
     // 2. 初始化 buf 结构
+    b.data = data_page;
     b.dev = 1; // 这里的 dev 其实在极简驱动里没用到，写个1意思一下
     b.blockno = 1; // 重要：不要写第0块，那是超级块或者引导块，写第1块比较安全
     b.valid = 0; // 还没读
@@ -5,6 +5,7 @@
 #include "../include/printf.h"
 #include "../include/proc.h"
 #include "../include/string.h"
+#include "../include/vm.h"
 
 // 内核根页表
 pagetable_t kernel_root_pagetable;
@@ -25,7 +26,7 @@ pagetable_t vmem_create_pagetable(void) {
 }
 
 // 根据虚拟地址 virtual_addr 找到对应的页表项，返回页表项的地址
-// 如果alloc非0，则分配物理内存，并设置页表项
+// 如果alloc非0，则分配物理内存，并设置页表项；alloc 为 VMEM_ALLOC_TRY 时内存不够返回 0，否则 panic
 // 仿照xv6的写法，在查找的过程中根据alloc决定是否创建
 // 如果没找到，返回0
 pte_t *vmem_walk_pte(pagetable_t pagetable, uint64 virtual_addr, int alloc) {
@@ -41,8 +42,10 @@ pte_t *vmem_walk_pte(pagetable_t pagetable, uint64 virtual_addr, int alloc) {
             pagetable = (pagetable_t) PTE_TO_PA(*pte);
         } else {
             if (!alloc) return 0; // 不分配，直接失败
-            pagetable = vmem_create_pagetable(); // 分配一个物理页
-            if (!pagetable) return 0; // 物理页分配失败，目前 kmem_alloc 会直接panic
+            // 分配一个物理页
+            pagetable = alloc == VMEM_ALLOC_TRY ? kmem_try_alloc() : vmem_create_pagetable();
+            if (!pagetable) return 0; // 物理页分配失败
+            memset(pagetable, 0, PAGE_SIZE);
             // 回到上一级的PTE（*pte）把刚申请到的新页表的物理地址填进去，
             // 并把它标记为有效。（只会标记三级和二级的，一级的不会标记）
             *pte = PA_TO_PTE(pagetable) | PTE_V;
@@ -55,10 +58,21 @@ pte_t *vmem_walk_pte(pagetable_t pagetable, uint64 virtual_addr, int alloc) {
     return pagetable + index;
 }
 
+static int vmem_map(pagetable_t pagetable, uint64 virtual_addr, uint64 physical_addr, int permission, int alloc);
+
 // 映射一个页表（va->pa）
 // permission：权限位，对应PTE的R,W,X,U,G,A,D,RWXUGA，一般用到RWX
 // TODO:这个操作不是原子的，分配失败没有释放
 int vmem_map_pagetable(pagetable_t pagetable, uint64 virtual_addr, uint64 physical_addr, int permission) {
+    return vmem_map(pagetable, virtual_addr, physical_addr, permission, 1);
+}
+
+// 和 vmem_map_pagetable 一样，但缺的页表页分配不到时返回 -1 而不是 panic，给缺页处理和 fork 用
+int vmem_map_try(pagetable_t pagetable, uint64 virtual_addr, uint64 physical_addr, int permission) {
+    return vmem_map(pagetable, virtual_addr, physical_addr, permission, VMEM_ALLOC_TRY);
+}
+
+static int vmem_map(pagetable_t pagetable, uint64 virtual_addr, uint64 physical_addr, int permission, int alloc) {
     if (virtual_addr % PAGE_SIZE != 0) {
         panic("vmem_map_pagetable: virtual_addr not aligned");
     }
@@ -66,7 +80,7 @@ int vmem_map_pagetable(pagetable_t pagetable, uint64 virtual_addr, uint64 physic
     if (physical_addr % PAGE_SIZE != 0) {
         panic("vmem_map_pagetable: physical_addr not aligned");
     }
-    pte_t *pte = vmem_walk_pte(pagetable, virtual_addr, 1);
+    pte_t *pte = vmem_walk_pte(pagetable, virtual_addr, alloc);
     if (pte == 0) return -1; // 创建页表项失败
     if (*pte & PTE_V) {
         // 该页已经存在并且被映射过
@@ -207,9 +221,9 @@ int vmem_user_copy(pagetable_t src_pt, pagetable_t dst_pt, uint64 size) {
         }
 
         // 2. 分配一页新的物理内存给子进程
-        char *new_pa = kmem_alloc();
+        // 内存不够时让 fork 失败，已经映射的页由调用者释放子进程时一起回收
+        char *new_pa = kmem_try_alloc();
         if (new_pa == 0) {
-            // (这里应该有一个错误回滚，释放所有已分配的页)
             return -1; // 内存不足
         }
 
@@ -219,41 +233,99 @@ int vmem_user_copy(pagetable_t src_pt, pagetable_t dst_pt, uint64 size) {
 
         // 4. 将子进程的新物理页映射到 *相同* 的虚拟地址
         int flags = PTE_FLAGS(*pte); // 获取旧的权限 (R,W,X,U)
-        if (vmem_map_pagetable(dst_pt, va, (uint64)new_pa, flags) != 0) {
+        if (vmem_map_try(dst_pt, va, (uint64)new_pa, flags) != 0) {
             kmem_free(new_pa);
-            // (错误回滚)
             return -1;
         }
     }
     return 0; // 成功
 }
 
-// 复制栈，用于fork
-int vmem_stack_copy(pagetable_t src_pt, pagetable_t dst_pt) {
-    // 目前栈只有一页
-    pte_t *pte = vmem_walk_pte(src_pt, USER_STACK_VA, 0);
-
-    if (pte == 0 || (*pte & PTE_V) == 0) {
-        panic("fork: no stack found"); // 或者返回-1
+// 用户栈是栈区里从 MAX_USER_VA 往下连续映射的一段，返回它的最低地址
+uint64 vmem_stack_base(pagetable_t pagetable) {
+    uint64 base = MAX_USER_VA;
+    while (base > USER_STACK_LIMIT) {
+        pte_t *pte = vmem_walk_pte(pagetable, base - PAGE_SIZE, 0);
+        if (pte == 0 || (*pte & PTE_V) == 0)
+            break;
+        base -= PAGE_SIZE;
     }
+    return base;
+}
 
-    char *new_pa = kmem_alloc();
-    if (new_pa == 0) {
+// 栈区里的缺页：把 va 所在页到现在的栈底之间都映射上一页 0，栈保持连续
+// va 不在栈区、或者已经映射了（权限不对）返回 -1
+int vmem_stack_grow(pagetable_t pagetable, uint64 va) {
+    if (va < USER_STACK_LIMIT || va >= MAX_USER_VA)
         return -1;
+    uint64 base = vmem_stack_base(pagetable);
+    if (va >= base)
+        return -1;
+    // 从栈底往下映射，中途内存不够时已经映射的部分仍然连续，进程被杀掉
+    for (; base > PAGE_DOWN(va); base -= PAGE_SIZE) {
+        char *pa = kmem_try_alloc();
+        if (pa == 0)
+            return -1;
+        memset(pa, 0, PAGE_SIZE);
+        if (vmem_map_try(pagetable, base - PAGE_SIZE, (uint64)pa, PTE_U | PTE_R | PTE_W) != 0) {
+            kmem_free(pa);
+            return -1;
+        }
+    }
+    return 0;
+}
+
+// 复制栈，用于fork，只复制已经长出来的页
+int vmem_stack_copy(pagetable_t src_pt, pagetable_t dst_pt) {
+    uint64 base = vmem_stack_base(src_pt);
+    if (base == MAX_USER_VA) {
+        panic("fork: no stack found");
     }
 
-    uint64 src_pa = PTE_TO_PA(*pte);
-    memmove(new_pa, (void*)src_pa, PAGE_SIZE);
+    for (uint64 va = base; va < MAX_USER_VA; va += PAGE_SIZE) {
+        pte_t *pte = vmem_walk_pte(src_pt, va, 0);
+        char *new_pa = kmem_try_alloc();
+        if (new_pa == 0) {
+            return -1; // 已经映射的部分由 proc_free_pagetable 释放
+        }
+
+        uint64 src_pa = PTE_TO_PA(*pte);
+        memmove(new_pa, (void*)src_pa, PAGE_SIZE);
 
-    int flags = PTE_FLAGS(*pte);
-    if (vmem_map_pagetable(dst_pt, USER_STACK_VA, (uint64)new_pa, flags) != 0) {
-        kmem_free(new_pa);
-        return -1;
+        int flags = PTE_FLAGS(*pte);
+        if (vmem_map_try(dst_pt, va, (uint64)new_pa, flags) != 0) {
+            kmem_free(new_pa);
+            return -1;
+        }
     }
 
     return 0;
 }
 
+// 找用户地址 va 的 PTE，要求 perm 里的权限位都有，不满足返回 0
+// 当前进程 mmap 区域和栈区里还没映射（或者还没给写权限）的页先走一遍缺页处理
+static pte_t *vmem_user_pte(pagetable_t pagetable, uint64 va, int perm) {
+    pte_t *pte = vmem_walk_pte(pagetable, va, 0);
+    if (pte && (*pte & perm) == perm)
+        return pte;
+    struct proc *p = proc_running();
+    if (p == 0 || p->pagetable != pagetable)
+        return 0;
+    if (vma_fault(p, va, (perm & PTE_W) ? PROT_WRITE : PROT_READ) < 0)
+        return 0;
+    return vmem_walk_pte(pagetable, va, 0);
+}
+
+// 把用户地址 [va, va + len) 里还没映射的页先缺页调进来，write 为 1 时还要可写，碰到不能访问的页就停
+// 文件读写在拿 inode 锁之前调用：缺页处理要拿映射的文件的 inode 锁，拷贝时就不用在拿着锁的情况下缺页了
+void vmem_user_prefault(pagetable_t pagetable, uint64 va, uint64 len, int write) {
+    int perm = PTE_V | PTE_U | (write ? PTE_W : 0);
+    for (uint64 a = PAGE_DOWN(va); a < va + len && a < MAX_USER_VA; a += PAGE_SIZE) {
+        if (vmem_user_pte(pagetable, a, perm) == 0)
+            return;
+    }
+}
+
 // 安全地从用户空间复制数据到内核空间,
 int vmem_copyin(pagetable_t pagetable, char *dst_kernel, uint64 src_user, uint64 len) {
     uint64 n, va_start, pa_base;
@@ -265,12 +337,13 @@ int vmem_copyin(pagetable_t pagetable, char *dst_kernel, uint64 src_user, uint64
             return -1;
         }
         // 2. 找到该虚拟地址所在的页的PTE
-        pte = vmem_walk_pte(pagetable, src_user, 0);
+        //    mmap 区域里还没映射的页在这里缺页调进来
+        pte = vmem_user_pte(pagetable, src_user, PTE_V | PTE_U);
         // 3. 安全检查
         //    PTE 必须存在 (pte != 0)
         //    PTE 必须是有效的 (PTE_V)
         //    PTE 必须是用户可访问的 (PTE_U)
-        if (pte == 0 || (*pte & PTE_V) == 0 || (*pte & PTE_U) == 0) {
+        if (pte == 0) {
             return -1; // 非法地址！
         }
         // 4. 计算可以从当前这一个物理页复制多少字节
@@ -304,13 +377,9 @@ uint64 vmem_walk_addr(pagetable_t pagetable, uint64 va)
     if(va >= MAX_VIRTUAL_ADDR)
         return 0;
 
-    pte = vmem_walk_pte(pagetable, va, 0);
+    pte = vmem_user_pte(pagetable, va, PTE_V | PTE_U);
     if(pte == 0)
         return 0;
-    if((*pte & PTE_V) == 0)
-        return 0;
-    if((*pte & PTE_U) == 0)
-        return 0;
     pa = PTE_TO_PA(*pte);
     return pa;
 }
@@ -327,11 +396,10 @@ int vmem_copyout(pagetable_t pagetable, uint64 dst_user, char *src_kernel, uint6
         }
 
         // 2. 找到PTE
-        pte = vmem_walk_pte(pagetable, dst_user, 0);
-
         // 3. 安全检查
         //    除了 V 和 U，我们必须检查可写权限 W
-        if (pte == 0 || (*pte & PTE_V) == 0 || (*pte & PTE_U) == 0 || (*pte & PTE_W) == 0) {
+        pte = vmem_user_pte(pagetable, dst_user, PTE_V | PTE_U | PTE_W);
+        if (pte == 0) {
             return -1; // 非法地址或不可写！
         }
 
@@ -356,6 +424,40 @@ int vmem_copyout(pagetable_t pagetable, uint64 dst_user, char *src_kernel, uint6
     return 0; // 成功
 }
 
+// 把用户空间 [dst_user, dst_user + len) 清零，按页整段 memset，
+// 读文件空洞时用，不用再一个字节一个字节地 copyout
+int vmem_zeroout(pagetable_t pagetable, uint64 dst_user, uint64 len) {
+    uint64 n, va_start, pa_base;
+    pte_t *pte;
+
+    while (len > 0) {
+        if (dst_user >= MAX_USER_VA) {
+            return -1;
+        }
+
+        // 和 vmem_copyout 一样要求页可写
+        pte = vmem_user_pte(pagetable, dst_user, PTE_V | PTE_U | PTE_W);
+        if (pte == 0) {
+            return -1;
+        }
+
+        va_start = PAGE_DOWN(dst_user);
+        pa_base = PTE_TO_PA(*pte);
+
+        n = PAGE_SIZE - (dst_user - va_start);
+        if (n > len) {
+            n = len;
+        }
+
+        memset((void *)(pa_base + (dst_user - va_start)), 0, n);
+
+        len -= n;
+        dst_user += n;
+    }
+
+    return 0;
+}
+
 int vmem_user_alloc(pagetable_t pagetable, uint64 old_size, uint64 new_size) {
     if(new_size < old_size)
         return 0;
@@ -0,0 +1,329 @@
+#include "../include/fs.h"
+#include "../include/kalloc.h"
+#include "../include/memlayout.h"
+#include "../include/printf.h"
+#include "../include/proc.h"
+#include "../include/shm.h"
+#include "../include/string.h"
+#include "../include/vm.h"
+
+// mmap：进程的映射记在 p->vmas 里，mmap 只占一段地址，页在第一次访问缺页时才映射
+// 共享映射和只读的私有映射直接把页缓存的页映射给用户，读大文件不用 read 再拷一遍；
+// 可写的私有映射缺页时拷一份，匿名映射给一页 0；共享内存段的页属于段，各进程映射同一页
+// 共享可写映射的页先按只读映射，第一次写再缺页加上 W，解除映射时 PTE 有 W 的页才标脏写回
+
+#define min(a, b) ((a) < (b) ? (a) : (b))
+#define max(a, b) ((a) > (b) ? (a) : (b))
+
+// 这段映射的页是不是直接用页缓存的页
+static int vma_cached(struct vma *v) {
+    return v->ip && ((v->flags & MAP_SHARED) || !(v->prot & PROT_WRITE));
+}
+
+static int vma_perm(int prot) {
+    int perm = PTE_U | PTE_R; // mmap 时已经保证了可写的一定可读
+    if (prot & PROT_WRITE)
+        perm |= PTE_W;
+    if (prot & PROT_EXEC)
+        perm |= PTE_X;
+    return perm;
+}
+
+// va 所在的那一页对应文件的第几页
+static uint vma_index(struct vma *v, uint64 va) {
+    return (v->off + (va - v->start)) / PAGE_SIZE;
+}
+
+static struct vma *vma_find(struct proc *p, uint64 va) {
+    for (int i = 0; i < NVMA; i++) {
+        struct vma *v = &p->vmas[i];
+        if (v->start && va >= v->start && va < v->end)
+            return v;
+    }
+    return 0;
+}
+
+static struct vma *vma_alloc(struct proc *p) {
+    for (int i = 0; i < NVMA; i++) {
+        if (p->vmas[i].start == 0)
+            return &p->vmas[i];
+    }
+    return 0;
+}
+
+// 最低的映射起点，堆不能长过它；没有映射返回 USER_MMAP_TOP
+uint64 vma_lowest(struct proc *p) {
+    uint64 low = USER_MMAP_TOP;
+    for (int i = 0; i < NVMA; i++) {
+        if (p->vmas[i].start && p->vmas[i].start < low)
+            low = p->vmas[i].start;
+    }
+    return low;
+}
+
+// 从 USER_MMAP_TOP 往下找一段放得下 len 字节的空地址，和堆之间至少空一页，找不到返回 0
+static uint64 vma_place(struct proc *p, uint64 len) {
+    uint64 end = USER_MMAP_TOP;
+    for (;;) {
+        if (end < len || end - len < PAGE_UP(p->size) + PAGE_SIZE)
+            return 0;
+        uint64 start = end - len;
+        struct vma *hit = 0;
+        for (int i = 0; i < NVMA; i++) {
+            struct vma *v = &p->vmas[i];
+            if (v->start && v->start < end && v->end > start && (hit == 0 || v->start < hit->start))
+                hit = v;
+        }
+        if (hit == 0)
+            return start;
+        end = hit->start;
+    }
+}
+
+// 释放槽位，放掉映射占着的 inode 或者共享内存段的引用
+// 文件可能已经被删了，inode 的最后一个引用要在事务里释放块
+static void vma_free(struct vma *v) {
+    struct inode *ip = v->ip;
+    if (v->shm)
+        shm_put(v->shm);
+    v->start = 0;
+    v->ip = 0;
+    v->shm = 0;
+    if (ip) {
+        fslog_op_begin();
+        fs_inode_release(ip);
+        fslog_op_end();
+    }
+}
+
+// 这个 vma 占一个文件或者段的引用（新建、fork、拆分）
+static void vma_dup(struct vma *v) {
+    if (v->ip)
+        v->ip->ref++;
+    if (v->shm)
+        shm_dup(v->shm);
+}
+
+// 建立一段映射，参数已经由系统调用检查过，成功时映射自己占一个 ip 或 shm 的引用，返回起始地址，失败返回 -1
+uint64 vma_mmap(struct proc *p, uint64 len, int prot, int flags, struct inode *ip, struct shmseg *shm, uint64 off) {
+    len = PAGE_UP(len);
+    struct vma *v = vma_alloc(p);
+    if (v == 0)
+        return -1;
+    uint64 start = vma_place(p, len);
+    if (start == 0)
+        return -1;
+    v->start = start;
+    v->end = start + len;
+    v->prot = prot;
+    v->flags = flags;
+    v->ip = ip;
+    v->shm = shm;
+    v->off = off;
+    vma_dup(v);
+    return start;
+}
+
+// 缺页要拿映射的文件的 inode 锁。锁的顺序：拿着一个 inode 锁时不能再等另一个 inode 的锁，
+// 不然两个进程交叉 read 对方映射的文件会死锁。file_read/file_write 拿锁前先把用户缓冲区缺页调进来，
+// 拷贝时还缺页、又拿着别的 inode 锁的话，映射的文件的锁空着才拿，被别人拿着这次访问就失败
+// 返回 1 表示拿了锁；0 表示 p 已经拿着这个锁（比如 read 一个文件到它自己的映射里），不用再拿；-1 表示拿不到
+static int vma_lock(struct proc *p, struct inode *ip) {
+    if (ip->lock.locked && ip->lock.pid == p->pid)
+        return 0;
+    if (ip->lock.locked && p->ilocks > 0)
+        return -1;
+    fs_inode_lock(ip);
+    return 1;
+}
+
+// 缺页处理：va 落在 p 的某段映射里、并且允许 access（PROT_*）这种访问的话，把这一页映射好返回 0，否则返回 -1
+// 物理内存不够也返回 -1，进程被杀掉而不是内核 panic（文件页来自页缓存，它先回收自己的干净页）
+// 由 trap_user 和 vm.c 里访问用户内存的函数调用，p 是当前进程
+// 栈区不归 vma 管，但缺页也从这里进来：栈往下长到 va
+int vma_fault(struct proc *p, uint64 va, int access) {
+    if (va >= USER_STACK_LIMIT && va < MAX_USER_VA)
+        return (access & PROT_EXEC) ? -1 : vmem_stack_grow(p->pagetable, va);
+
+    struct vma *v = vma_find(p, va);
+    if (v == 0 || (v->prot & access) != access)
+        return -1;
+    va = PAGE_DOWN(va);
+
+    pte_t *pte = vmem_walk_pte(p->pagetable, va, 0);
+    if (pte && (*pte & PTE_V)) {
+        // 已经映射了：只有共享可写映射的页第一次写会走到这里，加上 W，记下这页被写过
+        if ((access & PROT_WRITE) && !(*pte & PTE_W)) {
+            *pte |= PTE_W;
+            return 0;
+        }
+        return -1;
+    }
+
+    int perm = vma_perm(v->prot);
+    char *pa;
+    if (v->shm) {
+        uint index = vma_index(v, va);
+        if (index >= v->shm->npages || (pa = shm_page(v->shm, index)) == 0)
+            return -1;
+    } else if (v->ip == 0) {
+        pa = kmem_try_alloc();
+        if (pa == 0)
+            return -1;
+        memset(pa, 0, PAGE_SIZE);
+    } else {
+        struct inode *ip = v->ip;
+        uint index = vma_index(v, va);
+        // 文件末尾之后的页没有内容，访问算越界
+        if ((uint64) index * PAGE_SIZE >= ip->size)
+            return -1;
+        int locked = vma_lock(p, ip);
+        if (locked < 0)
+            return -1;
+        char *data = pcache_map(ip, index);
+        if (vma_cached(v)) {
+            pa = data;
+            if ((v->flags & MAP_SHARED) && !(access & PROT_WRITE))
+                perm &= ~PTE_W;
+        } else {
+            pa = kmem_try_alloc();
+            if (pa)
+                memmove(pa, data, PAGE_SIZE);
+            pcache_unmap(ip, index, 0);
+        }
+        if (locked)
+            fs_inode_unlock(ip);
+        if (pa == 0)
+            return -1;
+    }
+
+    if (vmem_map_try(p->pagetable, va, (uint64) pa, perm) != 0) {
+        if (vma_cached(v))
+            pcache_unmap(v->ip, vma_index(v, va), 0);
+        else if (v->shm == 0)
+            kmem_free(pa);
+        return -1;
+    }
+    return 0;
+}
+
+// 解除 v 里 [start, end) 已经映射了的页
+// 共享映射里写过的页要标脏，文件里是空洞的块当场分配，所以要进事务、拿 inode 锁
+static void vma_unmap_pages(struct proc *p, struct vma *v, uint64 start, uint64 end) {
+    int op = 0;
+    for (uint64 va = start; va < end; va += PAGE_SIZE) {
+        pte_t *pte = vmem_walk_pte(p->pagetable, va, 0);
+        if (pte == 0 || (*pte & PTE_V) == 0)
+            continue;
+        if (v->shm) {
+            // 页属于段，段的最后一个引用放掉时才释放
+            *pte = 0;
+            continue;
+        }
+        if (!vma_cached(v)) {
+            vmem_unmap_pagetable(p->pagetable, va, 1);
+            continue;
+        }
+        int dirty = (v->flags & MAP_SHARED) && (*pte & PTE_W);
+        *pte = 0;
+        if (dirty) {
+            if (!op) {
+                fslog_op_begin();
+                fs_inode_lock(v->ip);
+                op = 1;
+            } else if (pcache_txn_full()) {
+                fslog_commit();
+            }
+        }
+        pcache_unmap(v->ip, vma_index(v, va), dirty);
+    }
+    if (op) {
+        fs_inode_unlock(v->ip);
+        fslog_op_end();
+    }
+}
+
+// 解除 [addr, addr + len) 里的映射，一段映射可以只解除头、尾或者中间（中间的话拆成两段）
+int vma_munmap(struct proc *p, uint64 addr, uint64 len) {
+    if (addr % PAGE_SIZE != 0 || len == 0 || len > MAX_USER_VA)
+        return -1;
+    uint64 end = addr + PAGE_UP(len);
+
+    // 拆成两段要多一个槽位，先确认有，免得解除到一半失败
+    for (int i = 0; i < NVMA; i++) {
+        struct vma *v = &p->vmas[i];
+        if (v->start && v->start < addr && v->end > end && vma_alloc(p) == 0)
+            return -1;
+    }
+
+    for (int i = 0; i < NVMA; i++) {
+        struct vma *v = &p->vmas[i];
+        if (v->start == 0 || v->end <= addr || v->start >= end)
+            continue;
+        uint64 s = max(v->start, addr);
+        uint64 e = min(v->end, end);
+        vma_unmap_pages(p, v, s, e);
+        if (s == v->start && e == v->end) {
+            vma_free(v);
+        } else if (s == v->start) {
+            v->off += e - v->start;
+            v->start = e;
+        } else if (e == v->end) {
+            v->end = s;
+        } else {
+            struct vma *tail = vma_alloc(p);
+            *tail = *v;
+            tail->start = e;
+            tail->off = v->off + (e - v->start);
+            v->end = s;
+            vma_dup(tail);
+        }
+    }
+    return 0;
+}
+
+// fork：子进程继承所有映射。页缓存和共享内存段的页两边映射同一页，其他的拷一份
+// 失败时已经复制的部分留在 np 里，由 proc_free 清理
+int vma_fork(struct proc *p, struct proc *np) {
+    for (int i = 0; i < NVMA; i++) {
+        struct vma *v = &p->vmas[i];
+        if (v->start == 0)
+            continue;
+        np->vmas[i] = *v;
+        vma_dup(v);
+        for (uint64 va = v->start; va < v->end; va += PAGE_SIZE) {
+            pte_t *pte = vmem_walk_pte(p->pagetable, va, 0);
+            if (pte == 0 || (*pte & PTE_V) == 0)
+                continue;
+            uint64 pa = PTE_TO_PA(*pte);
+            if (vma_cached(v)) {
+                pcache_dup(v->ip, vma_index(v, va));
+            } else if (v->shm == 0) {
+                char *copy = kmem_try_alloc();
+                if (copy == 0)
+                    return -1;
+                memmove(copy, (void *) pa, PAGE_SIZE);
+                pa = (uint64) copy;
+            }
+            if (vmem_map_try(np->pagetable, va, pa, PTE_FLAGS(*pte)) != 0) {
+                if (vma_cached(v))
+                    pcache_unmap(v->ip, vma_index(v, va), 0);
+                else if (v->shm == 0)
+                    kmem_free((void *) pa);
+                return -1;
+            }
+        }
+    }
+    return 0;
+}
+
+// 解除进程的全部映射，exit、exec 换掉地址空间、以及回收进程时调用
+void vma_unmap_all(struct proc *p) {
+    for (int i = 0; i < NVMA; i++) {
+        struct vma *v = &p->vmas[i];
+        if (v->start == 0)
+            continue;
+        vma_unmap_pages(p, v, v->start, v->end);
+        vma_free(v);
+    }
+}
@@ -10,15 +10,23 @@
 
 // ==========================================
 
-// 创建的 inode 块数量
+// 默认的 inode 数量，可以用 -i 指定
 #define NINODES 200
 
 // 全局变量，方便各函数访问
 int fsfd;
 struct superblock sb;
-int datastart_block; // 数据区起始块号
+uint datastart_block; // 数据区起始块号
 
-int next_free_block; // 指向下一个可用的空闲数据块
+uint next_free_block; // 指向下一个可用的空闲数据块
+uint next_inode_num = 3; // 下一个可用的 inode 号，1 是根目录，2 是 console
+
+uint fs_flags = 0; // 写入超级块的挂载选项 (FS_FLAG_*)
+
+// 镜像布局参数，默认值可以用命令行覆盖
+uint fs_size = FSSIZE; // 总块数 (-s)
+uint fs_ninodes = NINODES; // inode 数 (-i)
+uint fs_nlog = FS_LOGMAX + 1; // 日志区块数，含日志头 (-l)
 
 // ==========================================
 // 1. 基础 IO 辅助函数
@@ -35,14 +43,15 @@ void die_fmt(const char *fmt, const char *arg) {
     exit(1);
 }
 
-// 辅助：转换 inode 号到磁盘偏移量
-unsigned int inode_offset(unsigned int i) {
-    return (sb.inodestart * BSIZE) + (i * sizeof(struct dinode));
+// 辅助：转换 inode 号到磁盘偏移量（几个 G 的镜像会超过 32 位）
+off_t inode_offset(unsigned int i) {
+    return (off_t) sb.inodestart * BSIZE + (off_t) i * sizeof(struct dinode);
 }
 
 // 写入一个磁盘块
-void write_block(int blockno, void *data) {
-    if (lseek(fsfd, blockno * BSIZE, SEEK_SET) != blockno * BSIZE) {
+void write_block(uint blockno, void *data) {
+    off_t off = (off_t) blockno * BSIZE;
+    if (lseek(fsfd, off, SEEK_SET) != off) {
         die("write_block: lseek failed");
     }
     if (write(fsfd, data, BSIZE) != BSIZE) {
@@ -51,8 +60,9 @@ void write_block(int blockno, void *data) {
 }
 
 // 读取一个磁盘块 (用于调试或回读)
-void read_block(int blockno, void *data) {
-    if (lseek(fsfd, blockno * BSIZE, SEEK_SET) != blockno * BSIZE) {
+void read_block(uint blockno, void *data) {
+    off_t off = (off_t) blockno * BSIZE;
+    if (lseek(fsfd, off, SEEK_SET) != off) {
         die("read_block: lseek failed");
     }
     if (read(fsfd, data, BSIZE) != BSIZE) {
@@ -73,7 +83,7 @@ void write_inode(uint inum, struct dinode *ip) {
 
 // 分配一个空闲数据块，返回块号
 int alloc_block() {
-    if (next_free_block >= FSSIZE) {
+    if (next_free_block >= fs_size) {
         die("mkfs: out of blocks (fs.img too small?)");
     }
     // 返回当前可用块，并将水位线推高
@@ -82,44 +92,96 @@ int alloc_block() {
     return next_free_block++;
 }
 
+// 把文件的第 bn 个逻辑块映射到磁盘块 b
+// 直接块写进 din->addrs；否则沿着一级/二级/三级间接块往下走，缺的间接块现场分配并清零
+void map_block(struct dinode *din, uint bn, uint b) {
+    if (bn < NDIRECT) {
+        din->addrs[bn] = b;
+        return;
+    }
+    bn -= NDIRECT;
+
+    // 落在第几级间接块，span 是这一级能覆盖的块数
+    uint span = NINDIRECT;
+    int level = 1;
+    while (bn >= span) {
+        bn -= span;
+        if (++level > 3) die("mkfs: file too large");
+        span *= NINDIRECT;
+    }
+
+    uint zero[NINDIRECT];
+    memset(zero, 0, sizeof(zero));
+    uint *top = &din->addrs[NDIRECT + level - 1];
+    if (*top == 0) {
+        *top = alloc_block();
+        write_block(*top, zero);
+    }
+
+    // 逐层读改写间接块
+    uint addr = *top;
+    for (int k = 0; k < level; k++) {
+        uint a[NINDIRECT];
+        span /= NINDIRECT;
+        uint idx = bn / span;
+        bn %= span;
+        read_block(addr, a);
+        if (k == level - 1) {
+            a[idx] = b;
+            write_block(addr, a);
+        } else {
+            if (a[idx] == 0) {
+                a[idx] = alloc_block();
+                write_block(a[idx], zero);
+                write_block(addr, a);
+            }
+            addr = a[idx];
+        }
+    }
+}
+
 // ==========================================
 // 2. 文件系统初始化逻辑
 // ==========================================
 
 // 初始化超级块参数
 void init_superblock() {
-    int nbitmap = (FSSIZE + BPB - 1) / BPB;
-    int ninodeblocks = (NINODES + IPB - 1) / IPB;
-    int nlog = LOGBLOCKS + 1;
+    uint nbitmap = (fs_size + BPB - 1) / BPB;
+    uint ninodeblocks = (fs_ninodes + IPB - 1) / IPB;
+    uint nimap = (fs_ninodes + BPB - 1) / BPB;
+    uint nlog = fs_nlog;
 
     // 计算元数据区大小
-    int nmeta = 2 + nlog + ninodeblocks + nbitmap;
+    uint nmeta = 2 + nlog + ninodeblocks + nimap + nbitmap;
+    if (nmeta + 1 >= fs_size) die_fmt("mkfs: %s", "fs size too small for the metadata");
 
     // 填充全局 sb 结构体
     sb.magic = FSMAGIC;
-    sb.size = FSSIZE;
-    sb.nblocks = FSSIZE - nmeta; // 数据块总数
-    sb.ninodes = NINODES;
+    sb.size = fs_size;
+    sb.nblocks = fs_size - nmeta; // 数据块总数
+    sb.ninodes = fs_ninodes;
     sb.nlog = nlog;
     sb.logstart = 2;
     sb.inodestart = 2 + nlog;
-    sb.bmapstart = 2 + nlog + ninodeblocks;
+    sb.imapstart = 2 + nlog + ninodeblocks;
+    sb.bmapstart = 2 + nlog + ninodeblocks + nimap;
+    sb.bsize = BSIZE;
+    sb.flags = fs_flags | FS_FLAG_COUNTS | FS_FLAG_TINDIRECT | FS_FLAG_INLINE | FS_FLAG_WIDEDIR | FS_FLAG_IMAP;
 
     // 计算数据区起始位置（供后续使用）
     datastart_block = nmeta;
     next_free_block = datastart_block + 1;
 
 
-    printf("Layout: Meta=%d blocks, DataStart=%d, DataBlocks=%d\n",
-           nmeta, datastart_block, sb.nblocks);
+    printf("Layout: BlockSize=%d, Size=%u, Log=%u, Inodes=%u (%u blocks), Meta=%u blocks, DataStart=%u, DataBlocks=%u\n",
+           BSIZE, fs_size, nlog, fs_ninodes, ninodeblocks, nmeta, datastart_block, sb.nblocks);
 }
 
-// 将整个磁盘清零
-void zero_disk() {
-    char buf[BSIZE];
-    memset(buf, 0, BSIZE);
-    for (int i = 0; i < FSSIZE; i++) {
-        write_block(i, buf);
+// 把镜像文件定成 fs_size 块，没写过的地方读出来都是 0（稀疏文件，几个 G 的镜像也不用真的写一遍）
+// 日志头、inode 表这些要求全 0 的区域就不用再清了
+void size_disk() {
+    if (ftruncate(fsfd, (off_t) fs_size * BSIZE) < 0) {
+        die("mkfs: ftruncate failed");
     }
 }
 
@@ -133,86 +195,135 @@ void write_superblock() {
     write_block(1, buf);
 }
 
-// 初始化位图：标记元数据区为占用(1)，数据区为空闲(0)
-void init_bitmap() {
-    int total_bits = FSSIZE;
-    int bitmap_bytes = (total_bits + 7) / 8;
-    int nbitmap_blocks = (FSSIZE + BPB - 1) / BPB;
-
-    char *bitmap = malloc(bitmap_bytes);
-    if (!bitmap) {
-        perror("malloc bitmap");
-        exit(1);
-    }
-
-    // 1. 全部标记为占用 (1)
-    memset(bitmap, 0xFF, bitmap_bytes);
-
-    // 2. 将有效空闲区标记为 0 (Free)
-    for (int i = next_free_block; i < FSSIZE; i++) {
-        int byte = i / 8;
-        int bit = i % 8;
-        bitmap[byte] &= ~(1 << bit); // 清零该位
-    }
-
-    // 3. 写入磁盘 (处理跨块和填充)
-    char buf[BSIZE];
-    int remaining = bitmap_bytes;
-    char *ptr = bitmap;
-
-    for (int i = 0; i < nbitmap_blocks; i++) {
-        // 默认填充 0xFF (防止最后一块只有一半数据时，尾部变成 00)
+// 写一个位图：nbits 个对象里编号 < nused 的占用(1)，其余空闲(0)；超出 nbits 的位也置 1，内核不会分配
+// 逐块生成，不用把整个位图放进内存
+void write_bitmap(uint start, uint nbits, uint nused) {
+    uint nblocks = (nbits + BPB - 1) / BPB;
+    uchar buf[BSIZE];
+    for (uint k = 0; k < nblocks; k++) {
         memset(buf, 0xff, BSIZE);
-
-        int copy_size = (remaining > BSIZE) ? BSIZE : remaining;
-        memmove(buf, ptr, copy_size);
-
-        write_block(sb.bmapstart + i, buf);
-
-        ptr += copy_size;
-        remaining -= copy_size;
+        uint lo = k * BPB;
+        uint hi = lo + BPB < nbits ? lo + BPB : nbits;
+        for (uint b = nused > lo ? nused : lo; b < hi; b++)
+            buf[(b - lo) / 8] &= ~(1 << ((b - lo) % 8));
+        write_block(start + k, buf);
     }
+}
 
-    free(bitmap);
-    printf("Bitmap updated. Used blocks: 0-%d. Free blocks: %d-%d.\n",
-           next_free_block - 1, next_free_block, FSSIZE - 1);
+// 初始化位图：数据块 bitmap 标记元数据区和已经写进去的文件为占用；inode bitmap 标记用掉的 inode
+void init_bitmap() {
+    write_bitmap(sb.bmapstart, fs_size, next_free_block);
+    write_bitmap(sb.imapstart, fs_ninodes, next_inode_num);
+    printf("Bitmap updated. Used blocks: 0-%u. Free blocks: %u-%u. Used inodes: 0-%u.\n",
+           next_free_block - 1, next_free_block, fs_size - 1, next_inode_num - 1);
 }
 
 // ==========================================
 // 3. 目录与文件创建逻辑
 // ==========================================
 
-// 初始化根目录 (Inode 1)
-void init_root_dir() {
-    struct dirent de[2];
+// 根目录的目录项先攒在内存里，文件都加完后由 write_root_dir 一次写出
+// 放得下一块就是普通的线性目录，放不下（或者 -x）就建哈希索引目录
+struct dirent *root_ents;
+int root_nents = 0;
+int root_cap = 0;
+int root_indexed = 0; // -x：根目录强制用索引格式
+
+// 索引目录的叶子只装到 3/4，给之后的创建留点位置，不至于一加文件就拆分
+#define DX_FILL (BSIZE / sizeof(struct dirent) * 3 / 4)
+
+void add_root_entry(uint inum, char *name) {
+    if (root_nents == root_cap) {
+        root_cap = root_cap ? root_cap * 2 : 64;
+        root_ents = realloc(root_ents, root_cap * sizeof(struct dirent));
+        if (!root_ents) die("mkfs: realloc root dir");
+    }
+    struct dirent *de = &root_ents[root_nents++];
+    memset(de, 0, sizeof(*de));
+    de->inum = inum;
+    strncpy(de->name, name, DIRSIZ);
+}
 
-    // 创建 "."
-    memset(&de[0], 0, sizeof(struct dirent));
-    de[0].inum = ROOT_INODE;
-    strcpy(de[0].name, ".");
+// 初始化根目录 (Inode 1)：先放 "." 和 ".."
+void init_root_dir() {
+    add_root_entry(ROOT_INODE, ".");
+    add_root_entry(ROOT_INODE, "..");
+}
 
-    // 创建 ".."
-    memset(&de[1], 0, sizeof(struct dirent));
-    de[1].inum = ROOT_INODE;
-    strcpy(de[1].name, "..");
+static int cmp_dirent_hash(const void *a, const void *b) {
+    uint ha = dx_hash(((struct dirent *) a)->name);
+    uint hb = dx_hash(((struct dirent *) b)->name);
+    return ha < hb ? -1 : ha > hb;
+}
 
-    // 1. 写入目录内容到数据块
-    // 这里的 datastart_block 就是根目录的数据块
-    // 注意：write_block 写入的是整个块，这里我们构造一个 buffer
-    char buf[BSIZE];
-    memset(buf, 0, BSIZE);
-    memmove(buf, de, sizeof(de));
-    write_block(datastart_block, buf);
+// 按哈希排好序装进叶子，第 0 块写 "."、".." 和 dx_root
+// 返回目录用了几块，块号映射进 din
+int build_indexed_root(struct dinode *din) {
+    char block0[BSIZE];
+    memset(block0, 0, BSIZE);
+    memmove(block0, root_ents, DX_ROOT_SLOT * sizeof(struct dirent));
+    struct dx_root *root = (struct dx_root *) (block0 + DX_ROOT_SLOT * sizeof(struct dirent));
+    struct dx_entry *e = (struct dx_entry *) (root + 1);
+    root->magic = DX_ROOT_MAGIC;
+    root->levels = 1;
+
+    struct dirent *ents = root_ents + DX_ROOT_SLOT;
+    int n = root_nents - DX_ROOT_SLOT;
+    qsort(ents, n, sizeof(struct dirent), cmp_dirent_hash);
+
+    din->addrs[0] = datastart_block;
+    int nblocks = 1;
+    int i = 0;
+    do {
+        // 一个叶子装 DX_FILL 项，但相同哈希的项必须在同一个叶子里
+        int j = i + DX_FILL < n ? i + DX_FILL : n;
+        while (j < n && j - i < BSIZE / sizeof(struct dirent) &&
+               dx_hash(ents[j].name) == dx_hash(ents[j - 1].name))
+            j++;
+        if (j < n && j > i && dx_hash(ents[j].name) == dx_hash(ents[j - 1].name))
+            die("mkfs: too many hash collisions in root dir");
+        if (root->count >= DX_ROOT_LIMIT)
+            die("mkfs: root dir too large");
+
+        char leaf[BSIZE];
+        memset(leaf, 0, BSIZE);
+        memmove(leaf, &ents[i], (j - i) * sizeof(struct dirent));
+        int b = alloc_block();
+        write_block(b, leaf);
+        map_block(din, nblocks, b);
+
+        e[root->count].hash = root->count == 0 ? 0 : dx_hash(ents[i].name);
+        e[root->count].block = nblocks;
+        root->count++;
+        nblocks++;
+        i = j;
+    } while (i < n);
+
+    write_block(datastart_block, block0);
+    return nblocks;
+}
 
-    // 2. 创建并写入 Inode
+// 写出根目录的数据块和 inode
+void write_root_dir() {
     struct dinode din;
     memset(&din, 0, sizeof(din));
     din.type = T_DIR;
     din.major = 0;
     din.minor = 0;
     din.nlink = 1;
-    din.size = sizeof(de);
-    din.addrs[0] = datastart_block; // 映射到刚刚写的数据块
+
+    if (root_indexed || root_nents > BSIZE / sizeof(struct dirent)) {
+        din.size = build_indexed_root(&din) * BSIZE;
+        printf("Root dir: %d entries, indexed, %d blocks\n", root_nents, din.size / BSIZE);
+    } else {
+        // 这里的 datastart_block 就是根目录的数据块
+        char buf[BSIZE];
+        memset(buf, 0, BSIZE);
+        memmove(buf, root_ents, root_nents * sizeof(struct dirent));
+        write_block(datastart_block, buf);
+        din.size = root_nents * sizeof(struct dirent);
+        din.addrs[0] = datastart_block; // 映射到刚刚写的数据块
+    }
 
     write_inode(ROOT_INODE, &din);
 }
@@ -221,39 +332,10 @@ void init_root_dir() {
 void add_console_device() {
     unsigned int console_inum = ROOT_INODE + 1; // 2
 
-    // 1. 构造目录项
-    struct dirent de;
-    memset(&de, 0, sizeof(de));
-    de.inum = console_inum;
-    strncpy(de.name, "console", DIRSIZ);
-
-    // 2. 将目录项追加到根目录数据块
-    // 我们知道根目录数据块在 datastart_block
-    // 且前 32 字节已被 . 和 .. 占用
-    // 更好的做法是读取当前 Inode size，但在 mkfs 阶段我们知道布局，直接算偏移
-    off_t offset = datastart_block * BSIZE + 2 * sizeof(struct dirent);
+    // 2. 加到根目录
+    add_root_entry(console_inum, "console");
 
-    if (lseek(fsfd, offset, SEEK_SET) != offset) {
-        perror("seek root dir for console");
-        exit(1);
-    }
-    if (write(fsfd, &de, sizeof(de)) != sizeof(de)) {
-        perror("write console dirent");
-        exit(1);
-    }
-
-    // 3. 更新根目录 Inode 的 size
-    // 为了简单，我们这里重新读取 Inode 或者直接构造新的覆盖
-    // 这里选择读取-修改-写入
-    struct dinode root_din;
-    off_t root_off = inode_offset(ROOT_INODE);
-    lseek(fsfd, root_off, SEEK_SET);
-    read(fsfd, &root_din, sizeof(root_din));
-
-    root_din.size += sizeof(struct dirent);
-    write_inode(ROOT_INODE, &root_din);
-
-    // 4. 创建 Console Inode
+    // 3. 创建 Console Inode
     struct dinode din_console;
     memset(&din_console, 0, sizeof(din_console));
     din_console.type = T_DEVICE;
@@ -268,7 +350,7 @@ void add_console_device() {
 // 将宿主机文件写入镜像
 // host_path: 宿主机上的文件路径 (如 "user/init")
 // fs_name:   文件系统里的文件名 (如 "init")
-// 核心：添加用户程序 (支持间接块！)
+// 核心：添加用户程序 (支持一级/二级/三级间接块！)
 void append_user_program(char *host_path, char *fs_name) {
     int fd = open(host_path, O_RDONLY);
     if (fd < 0) {
@@ -276,9 +358,8 @@ void append_user_program(char *host_path, char *fs_name) {
     }
 
     // 1. 分配 Inode
-    static int next_inode_num = 3;
-    int inum = next_inode_num++;
-    if (inum >= NINODES) die("mkfs: too many files");
+    uint inum = next_inode_num++;
+    if (inum >= fs_ninodes) die_fmt("mkfs: too many files (%s), use -i", fs_name);
 
     struct dinode din;
     memset(&din, 0, sizeof(din));
@@ -286,17 +367,21 @@ void append_user_program(char *host_path, char *fs_name) {
     din.nlink = 1;
     din.size = 0;
 
-    // 准备间接块缓冲区 (如果需要)
-    // 我们先把间接表存在内存里，文件写完后再写入磁盘
-    uint indirect[NINDIRECT];
-    memset(indirect, 0, sizeof(indirect));
-    int indirect_allocated_block = 0; // 记录间接表占用的磁盘块号
-
     char buf[BSIZE];
     int n;
 
-    // 2. 读取并写入数据
-    while ((n = read(fd, buf, BSIZE)) > 0) {
+    // 2. 放得进 inode 的小文件直接内联，不占数据块
+    n = read(fd, buf, BSIZE);
+    if (n >= 0 && n <= FS_INLINE_MAX && read(fd, buf + n, 1) == 0) {
+        din.flags = I_INLINE;
+        memmove(din.addrs, buf, n);
+        din.size = n;
+    } else if (lseek(fd, 0, SEEK_SET) != 0) {
+        die_fmt("Cannot rewind host file: %s", host_path);
+    }
+
+    // 3. 读取并写入数据
+    while (!(din.flags & I_INLINE) && (n = read(fd, buf, BSIZE)) > 0) {
         int logic_block_idx = din.size / BSIZE;
 
         if (logic_block_idx >= MAXFILE) {
@@ -312,75 +397,81 @@ void append_user_program(char *host_path, char *fs_name) {
         }
         write_block(b, buf);
 
-        // 建立映射
-        if (logic_block_idx < NDIRECT) {
-            // 直接块
-            din.addrs[logic_block_idx] = b;
-        } else {
-            // 间接块
-            // 如果是第一次用到间接块，先分配存放间接表的块
-            if (indirect_allocated_block == 0) {
-                indirect_allocated_block = alloc_block();
-                din.addrs[NDIRECT] = indirect_allocated_block;
-                // 注意：这里我们还没写这个块，只是先占个座
-            }
-            // 更新内存中的间接表
-            indirect[logic_block_idx - NDIRECT] = b;
-        }
+        // 建立映射 (直接块或各级间接块)
+        map_block(&din, logic_block_idx, b);
 
         din.size += n;
     }
     close(fd);
 
-    // 3. 如果用到了间接块，把间接表写入磁盘
-    if (indirect_allocated_block != 0) {
-        write_block(indirect_allocated_block, (char*)indirect);
-    }
-
     // 4. 写入文件 Inode
     write_inode(inum, &din);
 
     // 5. 将文件添加到根目录
-    struct dirent de;
-    memset(&de, 0, sizeof(de));
-    de.inum = inum;
-    strncpy(de.name, fs_name, DIRSIZ);
-
-    // 计算偏移量
-    // 根目录有: . (0), .. (1), console (2)
-    // 所以第 1 个用户文件在 index 3
-    // 这里我们依然利用 mkfs 的顺序执行特性，使用静态偏移量
-    // 更好的做法是维护一个 root_dir_size 变量
-    static int root_dir_entries = 3;
-    off_t off = datastart_block * BSIZE + root_dir_entries * sizeof(struct dirent);
-
-    // 写入目录项
-    if (lseek(fsfd, off, SEEK_SET) != off) die("root dir: lseek failed");
-    if (write(fsfd, &de, sizeof(de)) != sizeof(de)) die("root dir: write failed");
-    root_dir_entries++;
-
-    // 更新根目录大小
-    struct dinode root_din;
-    off_t root_off = inode_offset(ROOT_INODE);
-    lseek(fsfd, root_off, SEEK_SET);
-    read(fsfd, &root_din, sizeof(root_din));
-    root_din.size += sizeof(struct dirent);
-    write_inode(ROOT_INODE, &root_din);
-
-    printf("Added: %-15s (inum %d, size %d bytes)\n", fs_name, inum, din.size);
+    add_root_entry(inum, fs_name);
+
+    printf("Added: %-15s (inum %d, size %d bytes%s)\n", fs_name, inum, din.size,
+           (din.flags & I_INLINE) ? ", inline" : "");
 }
 
 // ==========================================
 // Main
 // ==========================================
 
+void usage() {
+    fprintf(stderr, "Usage: mkfs [-j data|ordered] [-x] [-s blocks] [-i inodes] [-l logblocks] fs.img [files...]\n");
+    fprintf(stderr, "  -j data     data blocks are journaled too (default)\n");
+    fprintf(stderr, "  -j ordered  only metadata is journaled, data goes home before commit\n");
+    fprintf(stderr, "  -x          build the root dir as a hash-indexed dir even if it fits in one block\n");
+    fprintf(stderr, "  -s blocks   total size in %d-byte blocks (default %d, up to %d)\n", BSIZE, FSSIZE, FS_MAXBMAP * BPB);
+    fprintf(stderr, "  -i inodes   number of inodes (default %d, up to %d)\n", NINODES, FS_MAXBMAP * BPB);
+    fprintf(stderr, "  -l blocks   log size including the header block (%d..%d, default %d)\n",
+            MAXOPBLOCKS + 1, (int) FS_LOGMAX + 1, (int) FS_LOGMAX + 1);
+    exit(1);
+}
+
+// 解析数字选项，不合法或超出 [lo, hi] 就打用法
+uint parse_num(char *arg, uint lo, uint hi) {
+    char *end;
+    unsigned long v = strtoul(arg, &end, 0);
+    if (*arg == 0 || *end != 0 || v < lo || v > hi) usage();
+    return v;
+}
+
 int main(int argc, char *argv[]) {
-    if (argc < 2) {
-        fprintf(stderr, "Usage: mkfs fs.img [files...]\n");
-        exit(1);
+    // 解析选项，选项必须写在镜像文件名前面
+    int argi = 1;
+    while (argi < argc && argv[argi][0] == '-') {
+        if (strcmp(argv[argi], "-j") == 0 && argi + 1 < argc) {
+            if (strcmp(argv[argi + 1], "ordered") == 0) {
+                fs_flags |= FS_FLAG_ORDERED;
+            } else if (strcmp(argv[argi + 1], "data") == 0) {
+                fs_flags &= ~FS_FLAG_ORDERED;
+            } else {
+                usage();
+            }
+            argi += 2;
+        } else if (strcmp(argv[argi], "-x") == 0) {
+            root_indexed = 1;
+            argi++;
+        } else if (strcmp(argv[argi], "-s") == 0 && argi + 1 < argc) {
+            fs_size = parse_num(argv[argi + 1], 64, FS_MAXBMAP * BPB);
+            argi += 2;
+        } else if (strcmp(argv[argi], "-i") == 0 && argi + 1 < argc) {
+            fs_ninodes = parse_num(argv[argi + 1], 8, FS_MAXBMAP * BPB);
+            argi += 2;
+        } else if (strcmp(argv[argi], "-l") == 0 && argi + 1 < argc) {
+            fs_nlog = parse_num(argv[argi + 1], MAXOPBLOCKS + 1, FS_LOGMAX + 1);
+            argi += 2;
+        } else {
+            usage();
+        }
+    }
+    if (argi >= argc) {
+        usage();
     }
 
-    fsfd = open(argv[1], O_RDWR | O_CREAT | O_TRUNC, 0666);
+    fsfd = open(argv[argi], O_RDWR | O_CREAT | O_TRUNC, 0666);
     if (fsfd < 0) {
         perror("open");
         exit(1);
@@ -388,13 +479,13 @@ int main(int argc, char *argv[]) {
 
 
     init_superblock();
-    write_superblock();
+    size_disk();
 
     init_root_dir(); // 占用 datastart_block
     add_console_device(); // 仅添加 inode 和 dirent
 
     // 处理命令行传入的文件
-    for (int i = 2; i < argc; i++) {
+    for (int i = argi + 1; i < argc; i++) {
         char *path = argv[i];
         char *name = strrchr(path, '/');
         if (name) name++;
@@ -405,11 +496,20 @@ int main(int argc, char *argv[]) {
         append_user_program(path, name);
     }
 
+    // 根目录的目录项都齐了，写出来（索引目录还要再分配叶子块）
+    write_root_dir();
+
     // 最后更新位图
     init_bitmap();
 
+    // 文件都放好了，空闲计数才确定，最后写超级块
+    sb.nfree_blocks = fs_size - next_free_block;
+    sb.nfree_inodes = fs_ninodes - next_inode_num;
+    write_superblock();
+
     fsync(fsfd);
     close(fsfd);
+    printf("Journal mode: %s\n", (fs_flags & FS_FLAG_ORDERED) ? "ordered" : "data");
     printf("✅ mkfs: fs.img created successfully!\n");
     return 0;
 }
@@ -15,7 +15,8 @@ int main(int argc, char *argv[]) {
     printf("Filesystem Usage:\n");
     printf("-----------------\n");
 
-    // 块信息 (假设块大小 1024B = 1KB)
+    // 块信息
+    printf("Block size    : %d\n", (uint32) info.block_size);
     printf("Blocks (Total): %d\n", (uint32) info.total_blocks);
     printf("Blocks (Free) : %d\n", (uint32) info.free_blocks);
     printf("Blocks (Used) : %d\n", (uint32) (info.total_blocks - info.free_blocks));
@@ -38,5 +39,9 @@ int main(int argc, char *argv[]) {
         inode_usage = (info.total_inodes - info.free_inodes) * 100 / info.total_inodes;
     printf("Usage         : %d%%\n", inode_usage);
 
+    printf("\n");
+    printf("Page cache    : %d pages (%d dirty)\n", (uint32) info.cached_pages, (uint32) info.dirty_pages);
+    printf("Free memory   : %d pages\n", (uint32) info.free_pages);
+
     exit(0);
 }
@@ -3,8 +3,7 @@
 //
 
 #include "ulib/user.h"
-
-#define BSIZE 1024
+#include "fs.h"
 
 void test_basic_crud();
 void test_directory_nesting();
@@ -110,15 +109,12 @@ void test_directory_nesting() {
 void test_large_file() {
     printf("\n[3/5] Testing Large File (Indirect Blocks)...\n");
 
-    char buf[BSIZE];
+    static char buf[BSIZE];
     int fd = open("bigfile", O_CREATE | O_RDWR);
     assert(fd >= 0, "create bigfile");
 
-    // 写入 16KB (超过直接块 12KB)
-    // 假设 BSIZE=512, NDIRECT=12. 12*512 = 6KB.
-    // 你的 NDIRECT 是 12 吗？如果是 12 个块，那就是 6KB。
-    // 如果是 16KB，肯定触发间接块。
-    int target_size = 20 * 1024;
+    // 写入 NDIRECT + 4 个块，超过直接块能覆盖的 NDIRECT * BSIZE 字节，肯定触发间接块
+    int target_size = (NDIRECT + 4) * BSIZE;
     printf("  - Writing %d bytes...\n", target_size);
 
     memset(buf, 'A', BSIZE);
@@ -133,8 +129,8 @@ void test_large_file() {
     printf("  - File size: %d (Expected %d)\n", st.size, target_size);
     assert(st.size == target_size, "size mismatch");
 
-    // Verify data at boundary (e.g., around 6KB)
-    char read_buf[BSIZE];
+    // 读回第一个块校验内容
+    static char read_buf[BSIZE];
     read(fd, read_buf, BSIZE);
     assert(read_buf[0] == 'A', "data mismatch");
 
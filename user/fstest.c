@@ -2,7 +2,7 @@
 #include "fs.h"
 
 // 用户空间文件系统压力测试
-#define BIG_FILE_SIZE (14 * 1024) // 14KB，足以触发间接块
+#define BIG_FILE_SIZE ((NDIRECT + 4) * BSIZE) // 比直接块多 4 块，足以触发间接块
 char buf[BSIZE];
 // 辅助：生成校验数据
 void pattern(char *s, int len, int offset) {
@@ -41,7 +41,7 @@ void test_bigfile() {
     printf("Verifying data...\n");
     for (int i = 0; i < BIG_FILE_SIZE; i += BSIZE) {
         pattern(buf, BSIZE, i);
-        char readbuf[BSIZE];
+        static char readbuf[BSIZE];
         if (read(fd, readbuf, BSIZE) != BSIZE) {
             printf("Error: read failed at %d\n", i);
             exit(1);
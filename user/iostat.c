@@ -0,0 +1,71 @@
+#include "ulib/user.h"
+
+// 用法：
+//   iostat            打印开机以来的磁盘驱动统计
+//   iostat cmd args   运行 cmd，打印它运行期间的增量
+//   iostat -p 0|1     设置磁盘等待方式：0 睡眠等中断，1 先轮询再睡眠
+
+static void print_stat(struct diskstat *st) {
+    printf("requests     : %d\n", (uint32) st->requests);
+    printf("blocks       : %d\n", (uint32) st->blocks);
+    printf("notifies     : %d\n", (uint32) st->notifies);
+    printf("notify skips : %d\n", (uint32) st->notify_skips);
+    printf("interrupts   : %d\n", (uint32) st->interrupts);
+    printf("poll hits    : %d\n", (uint32) st->poll_hits);
+    printf("poll misses  : %d\n", (uint32) st->poll_misses);
+    printf("sched queued : %d\n", (uint32) st->sched_queued);
+    printf("sched issued : %d\n", (uint32) st->sched_dispatched);
+    printf("sched merged : %d\n", (uint32) st->sched_merged);
+    printf("sched expired: %d\n", (uint32) st->sched_expired);
+    printf("queue depth  : %d (max %d)\n", (uint32) st->sched_depth, (uint32) st->sched_max_depth);
+}
+
+int main(int argc, char *argv[]) {
+    struct diskstat before, after;
+
+    if (argc == 3 && strcmp(argv[1], "-p") == 0) {
+        int old = diskpoll(atoi(argv[2]));
+        printf("poll mode: %d -> %d\n", old, atoi(argv[2]));
+        exit(0);
+    }
+
+    if (diskstat(&before) < 0) {
+        printf("iostat: diskstat failed\n");
+        exit(1);
+    }
+    printf("indirect desc: %d, event idx: %d\n", (uint32) before.indirect, (uint32) before.event_idx);
+    printf("poll mode: %d, poll budget: %d\n", (uint32) before.poll_mode, (uint32) before.poll_budget);
+
+    if (argc < 2) {
+        print_stat(&before);
+        exit(0);
+    }
+
+    int pid = fork();
+    if (pid < 0) {
+        printf("iostat: fork failed\n");
+        exit(1);
+    }
+    if (pid == 0) {
+        exec(argv[1], argv + 1);
+        printf("iostat: exec %s failed\n", argv[1]);
+        exit(1);
+    }
+    wait(0);
+
+    diskstat(&after);
+    after.requests -= before.requests;
+    after.blocks -= before.blocks;
+    after.notifies -= before.notifies;
+    after.notify_skips -= before.notify_skips;
+    after.interrupts -= before.interrupts;
+    after.poll_hits -= before.poll_hits;
+    after.poll_misses -= before.poll_misses;
+    after.sched_queued -= before.sched_queued;
+    after.sched_dispatched -= before.sched_dispatched;
+    after.sched_merged -= before.sched_merged;
+    after.sched_expired -= before.sched_expired;
+    printf("--- %s ---\n", argv[1]);
+    print_stat(&after);
+    exit(0);
+}
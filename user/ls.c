@@ -27,8 +27,8 @@ char* fmtname(char *path) {
 
 void ls(char *path) {
     char buf[512], *p;
-    int fd;
-    struct dirent de;
+    int fd, n;
+    static struct dirent des[BSIZE / sizeof(struct dirent)]; // 一次读一整块目录项，4K 块放栈上太大
     struct stat st;
 
     if((fd = open(path, 0)) < 0){
@@ -57,21 +57,23 @@ void ls(char *path) {
             p = buf+strlen(buf);
             *p++ = '/'; // 拼接路径
 
-            // 循环读取目录项
-            while(read(fd, &de, sizeof(de)) == sizeof(de)){
-                if(de.inum == 0) // 空槽位跳过
-                    continue;
+            // 循环读取目录项，一次读一块
+            while((n = read(fd, des, sizeof(des)) / sizeof(struct dirent)) > 0){
+                for(int i = 0; i < n; i++){
+                    if(des[i].inum == 0) // 空槽位跳过，索引目录的 dx_root/索引项开头也是 0
+                        continue;
 
-                // 拼接完整路径用于 stat
-                memmove(p, de.name, DIRSIZ);
-                p[DIRSIZ] = 0;
+                    // 拼接完整路径用于 stat
+                    memmove(p, des[i].name, DIRSIZ);
+                    p[DIRSIZ] = 0;
 
-                if(stat(buf, &st) < 0){
-                    printf("ls: cannot stat %s\n", buf);
-                    continue;
+                    if(stat(buf, &st) < 0){
+                        printf("ls: cannot stat %s\n", buf);
+                        continue;
+                    }
+                    // 打印：文件名 类型 Inode 大小
+                    printf("%s %d %d %d\n", fmtname(buf), st.type, st.ino, (int)st.size);
                 }
-                // 打印：文件名 类型 Inode 大小
-                printf("%s %d %d %d\n", fmtname(buf), st.type, st.ino, (int)st.size);
             }
             break;
     }
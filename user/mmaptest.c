@@ -0,0 +1,235 @@
+#include "ulib/user.h"
+
+#define PGSIZE 4096
+#define FILE_NAME "mmap.dat"
+#define BIG_NAME "mmap.big"
+#define BIG_SIZE (512 * 1024)
+
+static char buf[PGSIZE];
+
+void assert(int condition, char *msg) {
+    if (!condition) {
+        printf("❌ ASSERT FAILED: %s\n", msg);
+        exit(1);
+    }
+}
+
+// 第 i 个字节的内容
+static char pattern(int i) {
+    return 'a' + (i * 7 + i / 13) % 26;
+}
+
+// 建一个 3 页多一点的文件
+static int make_file(void) {
+    int n = 3 * PGSIZE + 100;
+    int fd = open(FILE_NAME, O_CREATE | O_RDWR);
+    assert(fd >= 0, "create file failed");
+    for (int off = 0; off < n; off += PGSIZE) {
+        int m = n - off < PGSIZE ? n - off : PGSIZE;
+        for (int i = 0; i < m; i++)
+            buf[i] = pattern(off + i);
+        assert(write(fd, buf, m) == m, "write file failed");
+    }
+    close(fd);
+    return n;
+}
+
+// 从文件偏移 off 读 1 个字节
+static char read_byte(int off) {
+    char c = 0;
+    int fd = open(FILE_NAME, O_RDONLY);
+    assert(fd >= 0, "open file failed");
+    for (int done = 0; done <= off;) {
+        int m = off - done + 1 < PGSIZE ? off - done + 1 : PGSIZE;
+        assert(read(fd, buf, m) == m, "read file failed");
+        done += m;
+        c = buf[m - 1];
+    }
+    close(fd);
+    return c;
+}
+
+void test_read_shared(int n) {
+    printf("\n[1/7] Read through a shared mapping...\n");
+    int fd = open(FILE_NAME, O_RDONLY);
+    char *p = mmap(0, n, PROT_READ, MAP_SHARED, fd, 0);
+    assert(p != MAP_FAILED, "mmap read-only failed");
+    close(fd); // 关掉 fd 映射还在
+    for (int i = 0; i < n; i++)
+        assert(p[i] == pattern(i), "mapped content mismatch");
+    // 文件末尾之后、同一页里的部分是 0
+    assert(p[n] == 0, "tail of last page not zero");
+    assert(munmap(p, n) == 0, "munmap failed");
+    printf("  ✅ passed.\n");
+}
+
+void test_write_shared(void) {
+    printf("\n[2/7] Write through a shared mapping...\n");
+    int fd = open(FILE_NAME, O_RDWR);
+    char *p = mmap(0, 2 * PGSIZE, PROT_READ | PROT_WRITE, MAP_SHARED, fd, PGSIZE);
+    assert(p != MAP_FAILED, "mmap shared failed");
+    close(fd);
+    p[0] = 'X';
+    p[PGSIZE + 5] = 'Y';
+    assert(munmap(p, 2 * PGSIZE) == 0, "munmap failed");
+    assert(read_byte(PGSIZE) == 'X', "shared write not in file");
+    assert(read_byte(2 * PGSIZE + 5) == 'Y', "shared write not in file");
+    printf("  ✅ passed.\n");
+}
+
+void test_private(void) {
+    printf("\n[3/7] Private file mapping and anonymous mapping...\n");
+    int fd = open(FILE_NAME, O_RDONLY);
+    char *p = mmap(0, PGSIZE, PROT_READ | PROT_WRITE, MAP_PRIVATE, fd, 0);
+    assert(p != MAP_FAILED, "mmap private failed");
+    close(fd);
+    assert(p[1] == pattern(1), "private content mismatch");
+    p[1] = '!';
+    assert(p[1] == '!', "private write lost");
+    munmap(p, PGSIZE);
+    assert(read_byte(1) == pattern(1), "private write leaked into file");
+
+    int *a = mmap(0, 4 * PGSIZE, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    assert((void *) a != MAP_FAILED, "mmap anonymous failed");
+    for (int i = 0; i < 4 * PGSIZE / 4; i++)
+        assert(a[i] == 0, "anonymous page not zero");
+    for (int i = 0; i < 4 * PGSIZE / 4; i++)
+        a[i] = i;
+    // 只解除中间两页，头尾还在
+    assert(munmap((char *) a + PGSIZE, 2 * PGSIZE) == 0, "partial munmap failed");
+    assert(a[0] == 0 && a[3 * PGSIZE / 4] == 3 * PGSIZE / 4, "partial munmap lost pages");
+    munmap(a, 4 * PGSIZE);
+    printf("  ✅ passed.\n");
+}
+
+void test_fork(void) {
+    printf("\n[4/7] Mappings across fork...\n");
+    int fd = open(FILE_NAME, O_RDWR);
+    char *shared = mmap(0, PGSIZE, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    close(fd);
+    char *anon = mmap(0, PGSIZE, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    assert(shared != MAP_FAILED && anon != MAP_FAILED, "mmap failed");
+    shared[10] = 'P';
+    anon[10] = 'P';
+
+    int pid = fork();
+    if (pid == 0) {
+        assert(shared[10] == 'P' && anon[10] == 'P', "child did not inherit mappings");
+        shared[11] = 'C';
+        anon[11] = 'C';
+        exit(0);
+    }
+    wait(0);
+    assert(shared[11] == 'C', "shared mapping not shared with child");
+    assert(anon[11] == 0, "anonymous mapping shared with child");
+    munmap(shared, PGSIZE);
+    munmap(anon, PGSIZE);
+    assert(read_byte(11) == 'C', "child's shared write not in file");
+    printf("  ✅ passed.\n");
+}
+
+void test_bad_access(int n) {
+    printf("\n[5/7] Bad accesses kill the process...\n");
+    int fd = open(FILE_NAME, O_RDONLY);
+    char *p = mmap(0, 8 * PGSIZE, PROT_READ, MAP_SHARED, fd, 0);
+    assert(p != MAP_FAILED, "mmap failed");
+    assert(mmap(0, PGSIZE, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0) == MAP_FAILED,
+           "shared writable mapping of read-only fd allowed");
+    close(fd);
+
+    int status = 0;
+    volatile char *vp = p;
+    // 只读映射里写、文件末尾之后的页、已经解除映射的地址
+    for (int k = 0; k < 3; k++) {
+        if (fork() == 0) {
+            if (k == 0)
+                vp[0] = 'z';
+            else if (k == 1)
+                status = vp[(n + PGSIZE - 1) / PGSIZE * PGSIZE];
+            else {
+                munmap(p, 8 * PGSIZE);
+                status = vp[0];
+            }
+            exit(status);
+        }
+        wait(&status);
+        assert(status == -1, "bad access not killed");
+    }
+    munmap(p, 8 * PGSIZE);
+    printf("  ✅ passed.\n");
+}
+
+void test_big_read(void) {
+    printf("\n[6/7] read() vs mmap on a %d KB file...\n", BIG_SIZE / 1024);
+    int fd = open(BIG_NAME, O_CREATE | O_RDWR);
+    for (int i = 0; i < PGSIZE; i++)
+        buf[i] = i;
+    for (int off = 0; off < BIG_SIZE; off += PGSIZE)
+        assert(write(fd, buf, PGSIZE) == PGSIZE, "write big file failed");
+    close(fd);
+
+    uint sum1 = 0, sum2 = 0;
+    int t0 = uptime();
+    fd = open(BIG_NAME, O_RDONLY);
+    for (int off = 0; off < BIG_SIZE; off += PGSIZE) {
+        read(fd, buf, PGSIZE);
+        for (int i = 0; i < PGSIZE; i++)
+            sum1 += (uchar) buf[i];
+    }
+    int t1 = uptime();
+    uchar *p = mmap(0, BIG_SIZE, PROT_READ, MAP_SHARED, fd, 0);
+    assert(p != MAP_FAILED, "mmap big file failed");
+    for (int i = 0; i < BIG_SIZE; i++)
+        sum2 += p[i];
+    int t2 = uptime();
+    close(fd);
+    munmap(p, BIG_SIZE);
+    unlink(BIG_NAME);
+    assert(sum1 == sum2, "checksum mismatch");
+    printf("  read: %d ticks, mmap: %d ticks\n", t1 - t0, t2 - t1);
+    printf("  ✅ passed.\n");
+}
+
+void test_fork_oom(void) {
+    printf("\n[7/7] fork under memory pressure...\n");
+    struct sysinfo info;
+    assert(sysinfo(&info) == 0, "sysinfo failed");
+    // 占掉三分之二的空闲内存，子进程再复制一份肯定放不下
+    uint64 len = info.free_pages * 2 / 3 * PGSIZE;
+    char *p = mmap(0, len, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    assert(p != MAP_FAILED, "mmap big anonymous region failed");
+    for (uint64 off = 0; off < len; off += PGSIZE)
+        p[off] = 1;
+    assert(sysinfo(&info) == 0, "sysinfo failed");
+    uint64 before = info.free_pages;
+
+    int pid = fork();
+    if (pid == 0)
+        exit(0);
+    assert(pid == -1, "fork should fail when memory runs out");
+    // 失败的 fork 要把复制了一半的子进程全部回收
+    assert(sysinfo(&info) == 0 && info.free_pages == before, "failed fork leaked pages");
+    munmap(p, len);
+
+    pid = fork();
+    if (pid == 0)
+        exit(0);
+    assert(pid > 0, "fork failed after memory was released");
+    wait(0);
+    printf("  ✅ passed.\n");
+}
+
+int main(void) {
+    printf("=== mmap test ===\n");
+    int n = make_file();
+    test_read_shared(n);
+    test_write_shared();
+    test_private();
+    test_fork();
+    test_bad_access(n);
+    test_big_read();
+    test_fork_oom();
+    unlink(FILE_NAME);
+    printf("\n✅ ALL MMAP TESTS PASSED\n");
+    exit(0);
+}
@@ -0,0 +1,134 @@
+#include "ulib/user.h"
+
+#define PGSIZE 4096
+#define SHM_KEY 42
+#define BUFFER_SIZE 8
+#define NUM_ITEMS 2000
+
+// 放在共享内存里的环形缓冲区，生产者和消费者直接读写，不用像 semtest 那样每次经过文件
+struct ring {
+    int in;
+    int out;
+    int buffer[BUFFER_SIZE];
+    int sum; // 消费者收到的总和
+};
+
+void assert(int condition, char *msg) {
+    if (!condition) {
+        printf("❌ ASSERT FAILED: %s\n", msg);
+        exit(1);
+    }
+}
+
+void test_key(void) {
+    printf("\n[1/4] Open a segment by key in two processes...\n");
+    char *p = shm_open(SHM_KEY, 2 * PGSIZE);
+    assert(p != MAP_FAILED, "shm_open failed");
+    assert(p[0] == 0 && p[2 * PGSIZE - 1] == 0, "new segment not zero");
+    assert(shm_open(0, PGSIZE) == MAP_FAILED, "key 0 allowed");
+    assert(shm_open(SHM_KEY, 3 * PGSIZE) == MAP_FAILED, "opened beyond segment size");
+
+    if (fork() == 0) {
+        // 子进程先解除继承来的映射，再按 key 自己打开一次
+        munmap(p, 2 * PGSIZE);
+        char *q = shm_open(SHM_KEY, PGSIZE);
+        assert(q != MAP_FAILED, "child shm_open failed");
+        strcpy(q, "hello from child");
+        munmap(q, PGSIZE);
+        exit(0);
+    }
+    wait(0);
+    assert(strcmp(p, "hello from child") == 0, "child's write not visible");
+    munmap(p, 2 * PGSIZE);
+
+    // 都解除了，段被释放，再打开是新的一段
+    p = shm_open(SHM_KEY, PGSIZE);
+    assert(p != MAP_FAILED, "reopen failed");
+    assert(p[0] == 0, "segment not freed after last detach");
+    munmap(p, PGSIZE);
+    printf("  ✅ passed.\n");
+}
+
+void test_producer_consumer(void) {
+    printf("\n[2/4] Producer/consumer over shared memory and semaphores...\n");
+    struct ring *r = shm_open(SHM_KEY, sizeof(struct ring));
+    assert(r != MAP_FAILED, "shm_open failed");
+    int mutex = sem_open(1);
+    int empty = sem_open(BUFFER_SIZE);
+    int full = sem_open(0);
+    assert(mutex >= 0 && empty >= 0 && full >= 0, "sem_open failed");
+
+    if (fork() == 0) {
+        for (int i = 1; i <= NUM_ITEMS; i++) {
+            sem_wait(empty);
+            sem_wait(mutex);
+            r->buffer[r->in] = i;
+            r->in = (r->in + 1) % BUFFER_SIZE;
+            sem_signal(mutex);
+            sem_signal(full);
+        }
+        exit(0);
+    }
+    if (fork() == 0) {
+        for (int i = 1; i <= NUM_ITEMS; i++) {
+            sem_wait(full);
+            sem_wait(mutex);
+            r->sum += r->buffer[r->out];
+            r->out = (r->out + 1) % BUFFER_SIZE;
+            sem_signal(mutex);
+            sem_signal(empty);
+        }
+        exit(0);
+    }
+    wait(0);
+    wait(0);
+    assert(r->sum == NUM_ITEMS * (NUM_ITEMS + 1) / 2, "consumer sum mismatch");
+    munmap(r, sizeof(struct ring));
+    printf("  ✅ passed.\n");
+}
+
+void test_anonymous(void) {
+    printf("\n[3/4] MAP_SHARED | MAP_ANONYMOUS across fork...\n");
+    int *a = mmap(0, 3 * PGSIZE, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+    assert((void *) a != MAP_FAILED, "shared anonymous mmap failed");
+    a[0] = 1;
+    if (fork() == 0) {
+        assert(a[0] == 1, "child did not inherit mapping");
+        // 父进程没碰过的页由子进程第一次访问，父进程也要看到同一页
+        a[2 * PGSIZE / 4] = 7;
+        a[0] = 2;
+        exit(0);
+    }
+    wait(0);
+    assert(a[0] == 2 && a[2 * PGSIZE / 4] == 7, "child's write not visible");
+    // 解除中间一页，两头还在
+    assert(munmap((char *) a + PGSIZE, PGSIZE) == 0, "partial munmap failed");
+    assert(a[0] == 2 && a[2 * PGSIZE / 4] == 7, "partial munmap lost pages");
+    munmap(a, 3 * PGSIZE);
+    printf("  ✅ passed.\n");
+}
+
+void test_exit_detach(void) {
+    printf("\n[4/4] Segments are detached on exit...\n");
+    // 子进程建段后不解除直接退出，反复做也不会把段表用完
+    for (int i = 0; i < 40; i++) {
+        if (fork() == 0) {
+            char *p = shm_open(SHM_KEY + 1 + i, PGSIZE);
+            assert(p != MAP_FAILED, "shm_open in child failed");
+            p[0] = 1;
+            exit(0);
+        }
+        wait(0);
+    }
+    printf("  ✅ passed.\n");
+}
+
+int main(void) {
+    printf("=== shared memory test ===\n");
+    test_key();
+    test_producer_consumer();
+    test_anonymous();
+    test_exit_detach();
+    printf("\n✅ ALL SHM TESTS PASSED\n");
+    exit(0);
+}
@@ -0,0 +1,111 @@
+#include "ulib/user.h"
+
+#define PGSIZE 4096
+#define FRAME 1024
+#define DEPTH 400 // 每层 1KB 多，总共 400KB 多，远超过 exec 时映射的一页
+
+void assert(int condition, char *msg) {
+    if (!condition) {
+        printf("❌ ASSERT FAILED: %s\n", msg);
+        exit(1);
+    }
+}
+
+// 每层在栈上放 1KB，返回时检查自己那一层没被别的层踩坏
+int recurse(int n, int do_fork) {
+    volatile char frame[FRAME];
+    for (int i = 0; i < FRAME; i++)
+        frame[i] = n + i;
+    int sum = 0;
+    if (n > 0) {
+        sum = recurse(n - 1, do_fork);
+    } else if (do_fork) {
+        // 在最深处 fork，子进程要带着整条长出来的栈
+        int pid = fork();
+        if (pid == 0)
+            return -1000000;
+        int status = 0;
+        wait(&status);
+        assert(status == 0, "child failed");
+    }
+    for (int i = 0; i < FRAME; i++)
+        assert(frame[i] == (char) (n + i), "stack frame corrupted");
+    return sum + n;
+}
+
+void test_deep_recursion(void) {
+    printf("\n[1/4] Recursion %d deep with %d bytes per frame...\n", DEPTH, FRAME);
+    assert(recurse(DEPTH, 0) == DEPTH * (DEPTH + 1) / 2, "recursion result mismatch");
+    printf("  ✅ passed.\n");
+}
+
+// 一次把栈往下推 64KB，先访问的是最低地址
+void big_local(void) {
+    volatile char buf[64 * 1024];
+    buf[0] = 'a';
+    buf[sizeof(buf) - 1] = 'z';
+    for (int i = 1; i < sizeof(buf) - 1; i += PGSIZE)
+        assert(buf[i] == 0, "new stack page not zero");
+    assert(buf[0] == 'a' && buf[sizeof(buf) - 1] == 'z', "big local lost");
+}
+
+// 系统调用往还没长出来的栈上写
+void read_into_stack(int fd) {
+    char buf[32 * 1024];
+    assert(read(fd, buf, 6) == 6, "read into stack failed");
+    assert(strcmp(buf, "stack") == 0, "read into stack mismatch");
+}
+
+void test_big_locals(void) {
+    printf("\n[2/4] Large local buffers and syscalls into new stack pages...\n");
+    big_local();
+    int fd[2];
+    assert(pipe(fd) == 0, "pipe failed");
+    write(fd[1], "stack", 6);
+    read_into_stack(fd[0]);
+    close(fd[0]);
+    close(fd[1]);
+    printf("  ✅ passed.\n");
+}
+
+void test_fork(void) {
+    printf("\n[3/4] Fork with a grown stack...\n");
+    int r = recurse(DEPTH, 1);
+    if (r < 0) {
+        // 子进程从最深处一路返回，每层都检查过了
+        exit(0);
+    }
+    assert(r == DEPTH * (DEPTH + 1) / 2, "recursion result mismatch");
+    printf("  ✅ passed.\n");
+}
+
+// 深度上限远超过栈的 1MB 上限，不会正常返回
+int overflow(int n) {
+    volatile char frame[FRAME];
+    frame[0] = n;
+    if (n > 100000)
+        return 0;
+    return overflow(n + 1) + frame[0];
+}
+
+void test_overflow(void) {
+    printf("\n[4/4] Unbounded recursion kills only the process...\n");
+    if (fork() == 0) {
+        overflow(0);
+        exit(0);
+    }
+    int status = 0;
+    wait(&status);
+    assert(status == -1, "stack overflow not killed");
+    printf("  ✅ passed.\n");
+}
+
+int main(void) {
+    printf("=== user stack test ===\n");
+    test_deep_recursion();
+    test_big_locals();
+    test_fork();
+    test_overflow();
+    printf("\n✅ ALL STACK TESTS PASSED\n");
+    exit(0);
+}
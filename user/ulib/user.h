@@ -76,6 +76,31 @@ int sleep(int n);
 
 int uptime(void);
 
+int diskstat(struct diskstat *);
+
+int diskpoll(int mode);
+
+#define PROT_READ  0x1
+#define PROT_WRITE 0x2
+#define PROT_EXEC  0x4
+#define MAP_SHARED    0x1
+#define MAP_PRIVATE   0x2
+#define MAP_ANONYMOUS 0x4
+#define MAP_FAILED ((void *) -1)
+// 把文件 fd 从 off（页对齐）开始的 len 字节映射进地址空间，页在第一次访问时才读进来
+// MAP_SHARED 的写会写回文件，MAP_PRIVATE 的写只改自己的副本；MAP_ANONYMOUS 不用 fd，初始全 0，
+// MAP_SHARED | MAP_ANONYMOUS 和 fork 出来的子进程共享
+// addr 目前被忽略，返回映射的起始地址，失败返回 MAP_FAILED
+void *mmap(void *addr, uint64 len, int prot, int flags, int fd, uint64 off);
+
+// 解除 [addr, addr + len) 里的映射，addr 要页对齐
+int munmap(void *addr, uint64 len);
+
+// 按 key（不能为 0）打开一段共享内存，没有就新建 size 字节的（初始全 0），可读写地映射进来
+// 用同一个 key 打开的进程、以及 fork 出来的子进程看到的是同一批物理页，配合 sem_* 做零拷贝的进程间通信
+// 返回映射的起始地址，失败返回 MAP_FAILED；用 munmap 解除，所有映射都解除后段被释放
+void *shm_open(int key, uint64 size);
+
 // uprintf.c
 int printf(const char *fmt, ...);
 